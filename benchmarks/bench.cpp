@@ -0,0 +1,316 @@
+// Runs each Lox workload in a forked child and reports wall time, heap
+// allocations and peak RSS, all from the fastest of its runs. A workload
+// fails if any run ends in a Lox error. Results can be saved and later used
+// as the baseline for another run:
+//
+//     ccloxx_bench --save=before.txt
+//     ... change the interpreter, rebuild ...
+//     ccloxx_bench --baseline=before.txt
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "runtime.hpp"
+#include "source.hpp"
+
+/*****************************************/
+// Allocation counting
+
+static size_t allocations = 0;
+static size_t allocatedBytes = 0;
+
+void *operator new(size_t size)
+{
+    allocations++;
+    allocatedBytes += size;
+    if (void *memory = std::malloc(size ? size : 1))
+        return memory;
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void *memory) noexcept
+{
+    std::free(memory);
+}
+
+/*****************************************/
+// Runner
+
+namespace
+{
+    struct Sample
+    {
+        double wallMs;
+        size_t allocations;
+        size_t allocatedBytes;
+        long peakRssKb;
+    };
+
+    struct Result
+    {
+        std::string name;
+        bool ok;
+
+        /// The run with the lowest wall time.
+        Sample best;
+    };
+
+    struct BenchOptions
+    {
+        lox::Options lox;
+        int runs = 3;
+        std::string baseline;
+        std::string save;
+        std::vector<std::string> paths;
+    };
+
+    std::string workloadName(const std::string &path)
+    {
+        size_t slash = path.find_last_of('/');
+        std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+        size_t dot = name.rfind(".lox");
+        return dot == std::string::npos ? name : name.substr(0, dot);
+    }
+
+    std::vector<std::string> defaultWorkloads()
+    {
+        std::vector<std::string> paths;
+        if (DIR *dir = opendir(CCLOXX_BENCH_DIR))
+        {
+            while (dirent *entry = readdir(dir))
+            {
+                std::string file = entry->d_name;
+                if (file.size() > 4 && file.compare(file.size() - 4, 4, ".lox") == 0)
+                    paths.push_back(std::string(CCLOXX_BENCH_DIR) + "/" + file);
+            }
+            closedir(dir);
+        }
+        std::sort(paths.begin(), paths.end());
+        return paths;
+    }
+
+    /// Child side: runs the script with stdout discarded and writes the
+    /// measured wall time and allocation counts to `fd`. Exits non-zero,
+    /// without writing them, if the script fails.
+    void runChild(const std::string &path, const lox::Options &options, int fd)
+    {
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+
+        lox::SourceBuffer source;
+        if (!source.open(path))
+            _exit(1);
+
+        allocations = 0;
+        allocatedBytes = 0;
+        auto start = std::chrono::steady_clock::now();
+        bool ok;
+        {
+            lox::Runtime runtime(options);
+            ok = lox::run(std::move(source), runtime);
+        }
+        if (!ok)
+            _exit(1);
+
+        Sample sample;
+        sample.wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        sample.allocations = allocations;
+        sample.allocatedBytes = allocatedBytes;
+        sample.peakRssKb = 0;
+
+        std::cout.flush();
+        if (write(fd, &sample, sizeof(sample)) != sizeof(sample))
+            _exit(1);
+        _exit(0);
+    }
+
+    bool runOnce(const std::string &path, const lox::Options &options, Sample &sample)
+    {
+        int fds[2];
+        if (pipe(fds) != 0)
+            return false;
+
+        std::cout.flush();
+        pid_t pid = fork();
+        if (pid < 0)
+            return false;
+        if (pid == 0)
+        {
+            close(fds[0]);
+            runChild(path, options, fds[1]);
+        }
+
+        close(fds[1]);
+        ssize_t count = read(fds[0], &sample, sizeof(sample));
+        close(fds[0]);
+
+        int status;
+        struct rusage usage;
+        if (wait4(pid, &status, 0, &usage) != pid)
+            return false;
+
+        sample.peakRssKb = usage.ru_maxrss;
+        return count == sizeof(sample) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+
+    Result runWorkload(const std::string &path, const BenchOptions &options)
+    {
+        Result result;
+        result.name = workloadName(path);
+        result.ok = true;
+
+        for (int i = 0; i < options.runs; i++)
+        {
+            Sample sample;
+            if (!runOnce(path, options.lox, sample))
+            {
+                result.ok = false;
+                break;
+            }
+
+            if (i == 0 || sample.wallMs < result.best.wallMs)
+                result.best = sample;
+        }
+        return result;
+    }
+
+    std::map<std::string, Sample> loadBaseline(const std::string &path)
+    {
+        std::map<std::string, Sample> samples;
+        std::ifstream file(path);
+        std::string name;
+        Sample sample;
+        while (file >> name >> sample.wallMs >> sample.allocations >> sample.allocatedBytes >> sample.peakRssKb)
+            samples[name] = sample;
+        return samples;
+    }
+
+    void saveResults(const std::string &path, const std::vector<Result> &results)
+    {
+        std::ofstream file(path);
+        for (auto &result : results)
+        {
+            if (!result.ok)
+                continue;
+            file << result.name << ' ' << result.best.wallMs << ' ' << result.best.allocations << ' '
+                 << result.best.allocatedBytes << ' ' << result.best.peakRssKb << '\n';
+        }
+    }
+
+    void printResults(const std::vector<Result> &results, const std::map<std::string, Sample> &baseline)
+    {
+        std::cout << std::left << std::setw(20) << "workload" << std::right
+                  << std::setw(12) << "wall ms"
+                  << std::setw(14) << "allocs"
+                  << std::setw(14) << "alloc KB"
+                  << std::setw(14) << "peak RSS KB";
+        if (!baseline.empty())
+            std::cout << std::setw(12) << "vs base";
+        std::cout << std::endl;
+
+        std::cout << std::fixed;
+        for (auto &result : results)
+        {
+            std::cout << std::left << std::setw(20) << result.name << std::right;
+            if (!result.ok)
+            {
+                std::cout << std::setw(12) << "failed" << std::endl;
+                continue;
+            }
+
+            const Sample &best = result.best;
+            std::cout << std::setw(12) << std::setprecision(1) << best.wallMs
+                      << std::setw(14) << best.allocations
+                      << std::setw(14) << best.allocatedBytes / 1024
+                      << std::setw(14) << best.peakRssKb;
+
+            auto base = baseline.find(result.name);
+            if (base != baseline.end() && base->second.wallMs > 0)
+                std::cout << std::setw(11) << std::setprecision(2) << best.wallMs / base->second.wallMs << "x";
+            std::cout << std::endl;
+        }
+    }
+
+    bool parseOptions(int argc, const char **argv, BenchOptions &options)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            const char *arg = argv[i];
+            if (std::strcmp(arg, "--engine=tree") == 0)
+                options.lox.engine = lox::Engine::Tree;
+            else if (std::strcmp(arg, "--engine=vm") == 0)
+                options.lox.engine = lox::Engine::VM;
+            else if (std::strncmp(arg, "--runs=", 7) == 0)
+                options.runs = std::max(1, std::atoi(arg + 7));
+            else if (std::strncmp(arg, "--baseline=", 11) == 0)
+                options.baseline = arg + 11;
+            else if (std::strncmp(arg, "--save=", 7) == 0)
+                options.save = arg + 7;
+            else if (arg[0] == '-')
+                return false;
+            else
+                options.paths.push_back(arg);
+        }
+        return true;
+    }
+} // namespace
+
+int main(int argc, const char **argv)
+{
+    BenchOptions options;
+    if (!parseOptions(argc, argv, options))
+    {
+        std::cerr << "Usage : ccloxx_bench [--engine=tree|vm] [--runs=<n>] [--baseline=<file>] "
+                     "[--save=<file>] [workload.lox ...]"
+                  << std::endl;
+        return 64;
+    }
+
+    if (options.paths.empty())
+        options.paths = defaultWorkloads();
+
+    std::map<std::string, Sample> baseline;
+    if (!options.baseline.empty())
+        baseline = loadBaseline(options.baseline);
+
+    std::vector<Result> results;
+    for (auto &path : options.paths)
+        results.push_back(runWorkload(path, options));
+
+    printResults(results, baseline);
+    if (!options.save.empty())
+        saveResults(options.save, results);
+
+    for (auto &result : results)
+    {
+        if (!result.ok)
+            return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,89 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace lox
+{
+
+    /// Bump-pointer allocator for objects that all die together, such as the
+    /// nodes of one parsed program. Objects are packed into large blocks in
+    /// allocation order; destructors run when the arena is destroyed.
+    class Arena
+    {
+    public:
+        static const size_t BLOCK_SIZE = 64 * 1024;
+
+        Arena() {}
+
+        ~Arena()
+        {
+            for (auto it = destructors.rbegin(); it != destructors.rend(); ++it)
+                it->destroy(it->object);
+        }
+
+        Arena(const Arena &) = delete;
+        Arena &operator=(const Arena &) = delete;
+
+        template <typename T, typename... Args>
+        T *make(Args &&... args)
+        {
+            void *memory = allocate(sizeof(T), alignof(T));
+            T *object = new (memory) T(std::forward<Args>(args)...);
+            if (!std::is_trivially_destructible<T>::value)
+                destructors.push_back({object, &destroy<T>});
+            return object;
+        }
+
+        void *allocate(size_t size, size_t align)
+        {
+            size_t offset = (used + align - 1) & ~(align - 1);
+            if (blocks.empty() || offset + size > capacity)
+            {
+                newBlock(size + align);
+                offset = (used + align - 1) & ~(align - 1);
+            }
+
+            used = offset + size;
+            return blocks.back().get() + offset;
+        }
+
+        /// Total bytes reserved for blocks, used or not.
+        size_t reserved() const { return totalReserved; }
+
+    private:
+        struct Destructor
+        {
+            void *object;
+            void (*destroy)(void *);
+        };
+
+        std::vector<std::unique_ptr<char[]>> blocks;
+        std::vector<Destructor> destructors;
+        size_t used = 0;
+        size_t capacity = 0;
+        size_t totalReserved = 0;
+
+        void newBlock(size_t minimum)
+        {
+            capacity = minimum > BLOCK_SIZE ? minimum : BLOCK_SIZE;
+            blocks.push_back(std::unique_ptr<char[]>(new char[capacity]));
+            used = 0;
+            totalReserved += capacity;
+        }
+
+        template <typename T>
+        static void destroy(void *object)
+        {
+            static_cast<T *>(object)->~T();
+        }
+    };
+} // namespace lox
+
+#endif
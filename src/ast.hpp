@@ -1,6 +1,7 @@
 #ifndef AST_HPP
 #define AST_HPP
 
+#include <cstdint>
 #include <memory>
 #include <vector>
 
@@ -9,7 +10,28 @@
 namespace lox
 {
 
-    using TokenPtr = std::shared_ptr<Token>;
+    class Value;
+    struct Ast;
+
+    /// Where a global name was last found, so later executions of the same
+    /// node can skip the hash lookup. `owner` is the id of the GlobalEnv
+    /// `slot` points into; the entry is only trusted when it matches.
+    struct GlobalCache
+    {
+        uint32_t owner = 0;
+        Value *slot = nullptr;
+    };
+
+    /// Hit and miss counts of a family of inline caches, shown by --ic-stats.
+    struct CacheStats
+    {
+        size_t hits = 0;
+        size_t misses = 0;
+    };
+
+    /// Tokens stay in the program's token list; nodes refer to them.
+    using TokenPtr = const Token *;
+    using ParamList = std::vector<TokenPtr>;
 
     class AssignExpr;
     class BinaryExpr;
@@ -22,6 +44,8 @@ namespace lox
     class LogicExpr;
     class UnaryExpr;
     class VarExpr;
+    class AddAssignExpr;
+    class CompareConstExpr;
 
     class ExprVisitor
     {
@@ -37,6 +61,8 @@ namespace lox
         virtual void visit(LogicExpr *expr) = 0;
         virtual void visit(VarExpr *expr) = 0;
         virtual void visit(UnaryExpr *expr) = 0;
+        virtual void visit(AddAssignExpr *expr) = 0;
+        virtual void visit(CompareConstExpr *expr) = 0;
     };
 
     enum class ExprType
@@ -51,7 +77,9 @@ namespace lox
         StrLiteralExprType,
         LogicalExprType,
         UnaryExprType,
-        VarExprType
+        VarExprType,
+        AddAssignExprType,
+        CompareConstExprType
     };
 
     class Expr
@@ -59,6 +87,9 @@ namespace lox
     public:
         ExprType type;
 
+        /// Source line the node is attributed to, set by the parser.
+        uint32_t line = 0;
+
         Expr(ExprType type_) : type(type_) {}
 
         virtual ~Expr() {}
@@ -70,11 +101,17 @@ namespace lox
     {
     public:
         TokenPtr name;
-        std::shared_ptr<Expr> value;
+        Expr *value;
+
+        /// Resolved and cached the same way as VarExpr.
+        int depth = -1;
+        int slot = -1;
+
+        GlobalCache cache;
 
-        AssignExpr(TokenPtr name_, std::shared_ptr<Expr> value_) : Expr(ExprType::AssignExprType),
-                                                                   name(name_),
-                                                                   value(value_) {}
+        AssignExpr(TokenPtr name_, Expr *value_) : Expr(ExprType::AssignExprType),
+                                                   name(name_),
+                                                   value(value_) { line = name->line; }
 
         void accept(ExprVisitor &visitor) override { visitor.visit(this); }
     };
@@ -82,15 +119,15 @@ namespace lox
     class BinaryExpr : public Expr
     {
     public:
-        std::shared_ptr<Expr> left;
+        Expr *left;
         TokenPtr op;
-        std::shared_ptr<Expr> right;
+        Expr *right;
 
-        BinaryExpr(std::shared_ptr<Expr> left_, TokenPtr op_,
-                   std::shared_ptr<Expr> right_) : Expr(ExprType::BinaryExprType),
-                                                   left(left_),
-                                                   op(op_),
-                                                   right(right_) {}
+        BinaryExpr(Expr *left_, TokenPtr op_,
+                   Expr *right_) : Expr(ExprType::BinaryExprType),
+                                   left(left_),
+                                   op(op_),
+                                   right(right_) { line = op->line; }
 
         void accept(ExprVisitor &visitor) override { visitor.visit(this); }
     };
@@ -98,13 +135,13 @@ namespace lox
     class CallExpr : public Expr
     {
     public:
-        std::shared_ptr<Expr> callee;
-        std::vector<std::shared_ptr<Expr>> arguments;
+        Expr *callee;
+        std::vector<Expr *> arguments;
 
-        CallExpr(std::shared_ptr<Expr> callee_,
-                 std::vector<std::shared_ptr<Expr>> &&arguments_) : Expr(ExprType::CallExprType),
-                                                                    callee(callee_),
-                                                                    arguments(arguments_) {}
+        CallExpr(Expr *callee_,
+                 std::vector<Expr *> &&arguments_) : Expr(ExprType::CallExprType),
+                                                     callee(callee_),
+                                                     arguments(arguments_) {}
 
         void accept(ExprVisitor &visitor) override { visitor.visit(this); }
     };
@@ -112,10 +149,10 @@ namespace lox
     class GroupingExpr : public Expr
     {
     public:
-        std::shared_ptr<Expr> expression;
+        Expr *expression;
 
-        GroupingExpr(std::shared_ptr<Expr> expression_) : Expr(ExprType::GroupExprType),
-                                                          expression(expression_) {}
+        GroupingExpr(Expr *expression_) : Expr(ExprType::GroupExprType),
+                                          expression(expression_) {}
 
         void accept(ExprVisitor &visitor) override { visitor.visit(this); }
     };
@@ -151,9 +188,9 @@ namespace lox
     class StrLiteralExpr : public Expr
     {
     public:
-        std::string literal;
+        StrObj *literal;
 
-        StrLiteralExpr(const std::string literal_) : Expr(ExprType::StrLiteralExprType), literal(literal_) {}
+        StrLiteralExpr(StrObj *literal_) : Expr(ExprType::StrLiteralExprType), literal(literal_) {}
 
         void accept(ExprVisitor &visitor) override { visitor.visit(this); }
     };
@@ -161,15 +198,15 @@ namespace lox
     class LogicExpr : public Expr
     {
     public:
-        std::shared_ptr<Expr> left;
+        Expr *left;
         TokenPtr opr;
-        std::shared_ptr<Expr> right;
+        Expr *right;
 
-        LogicExpr(std::shared_ptr<Expr> left_, TokenPtr opr_,
-                  std::shared_ptr<Expr> right_) : Expr(ExprType::LogicalExprType),
-                                                  left(left_),
-                                                  opr(opr_),
-                                                  right(right_) {}
+        LogicExpr(Expr *left_, TokenPtr opr_,
+                  Expr *right_) : Expr(ExprType::LogicalExprType),
+                                  left(left_),
+                                  opr(opr_),
+                                  right(right_) { line = opr->line; }
 
         void accept(ExprVisitor &visitor) override { visitor.visit(this); }
     };
@@ -179,6 +216,12 @@ namespace lox
     public:
         TokenPtr name;
 
+        /// Filled in by the Resolver; depth -1 means a global.
+        int depth = -1;
+        int slot = -1;
+
+        GlobalCache cache;
+
         VarExpr(TokenPtr name_) : Expr(ExprType::VarExprType),
                                   name(name_) {}
 
@@ -189,11 +232,56 @@ namespace lox
     {
     public:
         TokenPtr op;
-        std::shared_ptr<Expr> right;
+        Expr *right;
+
+        UnaryExpr(TokenPtr op_, Expr *right_) : Expr(ExprType::UnaryExprType),
+                                                op(op_),
+                                                right(right_) { line = op->line; }
+
+        void accept(ExprVisitor &visitor) override { visitor.visit(this); }
+    };
+
+    /// `name = name + operand`, fused by the Optimizer for the tree-walker
+    /// so the update needs no BinaryExpr or VarExpr of its own. Resolved
+    /// and cached like AssignExpr.
+    class AddAssignExpr : public Expr
+    {
+    public:
+        TokenPtr name;
+        Expr *operand;
+
+        int depth = -1;
+        int slot = -1;
+
+        GlobalCache cache;
+
+        AddAssignExpr(TokenPtr name_, Expr *operand_) : Expr(ExprType::AddAssignExprType),
+                                                        name(name_),
+                                                        operand(operand_) { line = name->line; }
+
+        void accept(ExprVisitor &visitor) override { visitor.visit(this); }
+    };
+
+    /// A comparison of a variable against a number literal, such as a loop
+    /// condition `i < 10`, fused by the Optimizer for the tree-walker.
+    /// Resolved and cached like VarExpr.
+    class CompareConstExpr : public Expr
+    {
+    public:
+        TokenPtr name;
+        TokenPtr op;
+        double constant;
+
+        int depth = -1;
+        int slot = -1;
+
+        GlobalCache cache;
 
-        UnaryExpr(TokenPtr op_, std::shared_ptr<Expr> right_) : Expr(ExprType::UnaryExprType),
-                                                                op(op_),
-                                                                right(right_) {}
+        CompareConstExpr(TokenPtr name_, TokenPtr op_,
+                         double constant_) : Expr(ExprType::CompareConstExprType),
+                                             name(name_),
+                                             op(op_),
+                                             constant(constant_) { line = op->line; }
 
         void accept(ExprVisitor &visitor) override { visitor.visit(this); }
     };
@@ -240,6 +328,9 @@ namespace lox
     public:
         StmtType type;
 
+        /// Line the statement starts on, set by the parser.
+        uint32_t line = 0;
+
         Stmt(StmtType type_) : type(type_) {}
 
         virtual ~Stmt() {}
@@ -250,10 +341,10 @@ namespace lox
     class ExprStmt : public Stmt
     {
     public:
-        std::shared_ptr<Expr> expression;
+        Expr *expression;
 
-        ExprStmt(std::shared_ptr<Expr> expression_) : Stmt(StmtType::ExprStmtType),
-                                                      expression(expression_) {}
+        ExprStmt(Expr *expression_) : Stmt(StmtType::ExprStmtType),
+                                      expression(expression_) {}
 
         void accept(StmtVisitor &visitor) override { visitor.visit(this); }
     };
@@ -262,15 +353,29 @@ namespace lox
     {
     public:
         TokenPtr name;
-        TokenList params;
-        std::vector<std::shared_ptr<Stmt>> body;
+        ParamList params;
+        std::vector<Stmt *> body;
+
+        /// Slot of the function name in its scope (-1 for globals) and the
+        /// number of slots its call frame needs, params included.
+        int slot = -1;
+        size_t slotCount = 0;
+
+        /// Whether the body declares a function, whose closure could keep
+        /// the call frame alive after the call returns. Set by the Resolver.
+        bool captured = true;
+
+        /// Set while a lazy Parser has left the body unparsed: it starts at
+        /// token `bodyStart` of `lazyAst`. See Parser::materialize().
+        Ast *lazyAst = nullptr;
+        size_t bodyStart = 0;
 
         FuncStmt(TokenPtr name_,
-                 TokenList &&params_,
-                 std::vector<std::shared_ptr<Stmt>> &&body_) : Stmt(StmtType::FuncStmtType),
-                                                               name(name_),
-                                                               params(params_),
-                                                               body(body_) {}
+                 ParamList &&params_,
+                 std::vector<Stmt *> &&body_) : Stmt(StmtType::FuncStmtType),
+                                                name(name_),
+                                                params(params_),
+                                                body(body_) {}
 
         void accept(StmtVisitor &visitor) override { visitor.visit(this); }
     };
@@ -278,9 +383,15 @@ namespace lox
     class BlockStmt : public Stmt
     {
     public:
-        std::vector<std::shared_ptr<Stmt>> statements;
+        std::vector<Stmt *> statements;
+
+        /// Set by the Resolver. A block with no slots runs in the enclosing
+        /// Env; one that is not `captured` declares no functions, so no
+        /// closure can outlive it holding its Env.
+        size_t slotCount = 0;
+        bool captured = true;
 
-        BlockStmt(std::vector<std::shared_ptr<Stmt>> &&statements_) : Stmt(StmtType::BlockStmtType), statements(statements_) {}
+        BlockStmt(std::vector<Stmt *> &&statements_) : Stmt(StmtType::BlockStmtType), statements(statements_) {}
 
         void accept(StmtVisitor &visitor) override { visitor.visit(this); }
     };
@@ -288,12 +399,12 @@ namespace lox
     class IfStmt : public Stmt
     {
     public:
-        std::shared_ptr<Expr> condition;
-        std::shared_ptr<Stmt> thenBranch;
-        std::shared_ptr<Stmt> elseBranch;
+        Expr *condition;
+        Stmt *thenBranch;
+        Stmt *elseBranch;
 
-        IfStmt(std::shared_ptr<Expr> condition_, std::shared_ptr<Stmt> thenBranch_,
-               std::shared_ptr<Stmt> elseBranch_)
+        IfStmt(Expr *condition_, Stmt *thenBranch_,
+               Stmt *elseBranch_)
             : Stmt(StmtType::IfStmtType),
               condition(condition_),
               thenBranch(thenBranch_),
@@ -305,9 +416,9 @@ namespace lox
     class PrintStmt : public Stmt
     {
     public:
-        std::shared_ptr<Expr> expression;
+        Expr *expression;
 
-        PrintStmt(std::shared_ptr<Expr> expression_)
+        PrintStmt(Expr *expression_)
             : Stmt(StmtType::PrintStmtType), expression(expression_) {}
 
         void accept(StmtVisitor &visitor) override { visitor.visit(this); }
@@ -317,9 +428,9 @@ namespace lox
     {
     public:
         TokenPtr keyword;
-        std::shared_ptr<Expr> value;
+        Expr *value;
 
-        ReturnStmt(TokenPtr keyword_, std::shared_ptr<Expr> value_)
+        ReturnStmt(TokenPtr keyword_, Expr *value_)
             : Stmt(StmtType::ReturnStmtType),
               keyword(keyword_),
               value(value_) {}
@@ -331,9 +442,11 @@ namespace lox
     {
     public:
         TokenPtr name;
-        std::shared_ptr<Expr> initializer;
+        Expr *initializer;
 
-        VarStmt(TokenPtr name_, std::shared_ptr<Expr> initializer_)
+        int slot = -1;
+
+        VarStmt(TokenPtr name_, Expr *initializer_)
             : Stmt(StmtType::VarStmtType),
               name(name_),
               initializer(initializer_) {}
@@ -344,13 +457,18 @@ namespace lox
     class WhileStmt : public Stmt
     {
     public:
-        std::shared_ptr<Expr> condition;
-        std::shared_ptr<Stmt> body;
+        Expr *condition;
+        Stmt *body;
+
+        /// A `for` loop's increment, evaluated after each run of the body
+        /// without a scope of its own; null for plain `while` loops.
+        Expr *increment;
 
-        WhileStmt(std::shared_ptr<Expr> condition_, std::shared_ptr<Stmt> body_)
+        WhileStmt(Expr *condition_, Stmt *body_, Expr *increment_ = nullptr)
             : Stmt(StmtType::WhileStmtType),
               condition(condition_),
-              body(body_) {}
+              body(body_),
+              increment(increment_) {}
 
         void accept(StmtVisitor &visitor) override { visitor.visit(this); }
     };
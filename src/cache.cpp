@@ -0,0 +1,569 @@
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <unordered_map>
+#include <vector>
+
+#include <elf.h>
+#include <link.h>
+#include <unistd.h>
+
+#include "cache.hpp"
+
+using namespace lox;
+
+namespace
+{
+    const char MAGIC[4] = {'L', 'X', 'A', 'C'};
+
+    /// Tag written in place of a missing child node.
+    const uint8_t NULL_TAG = 0xff;
+
+    struct Header
+    {
+        char magic[4];
+        uint32_t tokenCount;
+
+        /// The interpreter that wrote the file; see buildId().
+        uint64_t build;
+        uint64_t sourceHash;
+        uint64_t sourceSize;
+    };
+
+    struct CachedToken
+    {
+        uint32_t offset;
+        uint32_t length;
+        uint32_t line;
+        uint32_t type;
+    };
+
+    // FNV-1a
+    uint64_t hash(const char *chars, size_t length)
+    {
+        uint64_t value = 14695981039346656037ull;
+        for (size_t i = 0; i < length; i++)
+        {
+            value ^= static_cast<unsigned char>(chars[i]);
+            value *= 1099511628211ull;
+        }
+        return value;
+    }
+
+    /// Looks for the GNU build ID note among the main program's segments.
+    int findBuildId(dl_phdr_info *info, size_t, void *data)
+    {
+        std::string &id = *static_cast<std::string *>(data);
+        for (ElfW(Half) i = 0; i < info->dlpi_phnum; i++)
+        {
+            const ElfW(Phdr) &segment = info->dlpi_phdr[i];
+            if (segment.p_type != PT_NOTE)
+                continue;
+
+            const char *note = reinterpret_cast<const char *>(info->dlpi_addr + segment.p_vaddr);
+            const char *end = note + segment.p_memsz;
+            while (note + sizeof(ElfW(Nhdr)) <= end)
+            {
+                const ElfW(Nhdr) *header = reinterpret_cast<const ElfW(Nhdr) *>(note);
+                const char *name = note + sizeof(ElfW(Nhdr));
+                const char *desc = name + (header->n_namesz + 3) / 4 * 4;
+                if (header->n_type == NT_GNU_BUILD_ID && header->n_namesz == 4 &&
+                    std::memcmp(name, "GNU", 4) == 0 && desc + header->n_descsz <= end)
+                {
+                    id.assign(desc, header->n_descsz);
+                    return 1;
+                }
+                note = desc + (header->n_descsz + 3) / 4 * 4;
+            }
+        }
+        // The main program comes first; shared libraries are not part of
+        // the interpreter.
+        return 1;
+    }
+
+    /// Identifies the interpreter binary, so a tree saved by any other
+    /// build, whose nodes or encoding may differ, is never loaded. This is
+    /// the build ID the linker stamps into the executable, or a hash of the
+    /// whole executable if it has none. Zero if neither can be had, which
+    /// turns the cache off.
+    uint64_t buildId()
+    {
+        static const uint64_t id = [] {
+            std::string bytes;
+            dl_iterate_phdr(findBuildId, &bytes);
+            if (bytes.empty())
+            {
+                std::ifstream exe("/proc/self/exe", std::ios::binary);
+                bytes.assign(std::istreambuf_iterator<char>(exe), std::istreambuf_iterator<char>());
+            }
+            return bytes.empty() ? 0 : hash(bytes.data(), bytes.size());
+        }();
+        return id;
+    }
+
+    /// Encodes a tree in pre-order, collecting the tokens it refers to.
+    class Writer : public ExprVisitor, StmtVisitor
+    {
+    public:
+        std::string nodes;
+        std::vector<TokenPtr> tokens;
+
+        /// Cleared if the tree holds something that cannot be saved, such
+        /// as a token outside the source.
+        bool ok = true;
+
+        Writer(const SourceBuffer &source_) : source(source_) {}
+
+        void add(Expr *expr)
+        {
+            if (expr)
+            {
+                put<uint8_t>(static_cast<uint8_t>(expr->type));
+                put<uint32_t>(expr->line);
+                expr->accept(*this);
+            }
+            else
+                put<uint8_t>(NULL_TAG);
+        }
+
+        void add(Stmt *stmt)
+        {
+            if (stmt)
+            {
+                put<uint8_t>(static_cast<uint8_t>(stmt->type));
+                put<uint32_t>(stmt->line);
+                stmt->accept(*this);
+            }
+            else
+                put<uint8_t>(NULL_TAG);
+        }
+
+        void add(const StmtList &statements)
+        {
+            put<uint32_t>(static_cast<uint32_t>(statements.size()));
+            for (auto &stmt : statements)
+                add(stmt);
+        }
+
+    private:
+        const SourceBuffer &source;
+        std::unordered_map<TokenPtr, uint32_t> indices;
+
+        template <typename T>
+        void put(T value)
+        {
+            nodes.append(reinterpret_cast<const char *>(&value), sizeof(T));
+        }
+
+        void add(TokenPtr token)
+        {
+            if (token->start < source.data() || token->start + token->length > source.data() + source.size())
+                ok = false;
+
+            auto inserted = indices.insert({token, static_cast<uint32_t>(tokens.size())});
+            if (inserted.second)
+                tokens.push_back(token);
+            put<uint32_t>(inserted.first->second);
+        }
+
+        void visit(AssignExpr *expr) override { add(expr->name), add(expr->value); }
+        void visit(BinaryExpr *expr) override { add(expr->left), add(expr->op), add(expr->right); }
+        void visit(CallExpr *expr) override
+        {
+            add(expr->callee);
+            put<uint32_t>(static_cast<uint32_t>(expr->arguments.size()));
+            for (auto &arg : expr->arguments)
+                add(arg);
+        }
+        void visit(GroupingExpr *expr) override { add(expr->expression); }
+        void visit(NilLiteralExpr *) override {}
+        void visit(BoolLiteralExpr *expr) override { put<uint8_t>(expr->literal); }
+        void visit(NumLiteralExpr *expr) override { put<double>(expr->literal); }
+        void visit(StrLiteralExpr *expr) override
+        {
+            put<uint32_t>(static_cast<uint32_t>(expr->literal->value.size()));
+            nodes.append(expr->literal->value);
+        }
+        void visit(LogicExpr *expr) override { add(expr->left), add(expr->opr), add(expr->right); }
+        void visit(UnaryExpr *expr) override { add(expr->op), add(expr->right); }
+        void visit(VarExpr *expr) override { add(expr->name); }
+
+        // Only the optimizer creates these, after the tree was saved.
+        void visit(AddAssignExpr *) override { ok = false; }
+        void visit(CompareConstExpr *) override { ok = false; }
+
+        void visit(BlockStmt *stmt) override { add(stmt->statements); }
+        void visit(ExprStmt *stmt) override { add(stmt->expression); }
+        void visit(FuncStmt *stmt) override
+        {
+            if (stmt->lazyAst)
+                ok = false;
+            add(stmt->name);
+            put<uint32_t>(static_cast<uint32_t>(stmt->params.size()));
+            for (auto &param : stmt->params)
+                add(param);
+            add(stmt->body);
+        }
+        void visit(IfStmt *stmt) override { add(stmt->condition), add(stmt->thenBranch), add(stmt->elseBranch); }
+        void visit(PrintStmt *stmt) override { add(stmt->expression); }
+        void visit(ReturnStmt *stmt) override { add(stmt->keyword), add(stmt->value); }
+        void visit(VarStmt *stmt) override { add(stmt->name), add(stmt->initializer); }
+        void visit(WhileStmt *stmt) override { add(stmt->condition), add(stmt->body), add(stmt->increment); }
+    };
+
+    /// Thrown by Reader on input that does not decode to a valid tree.
+    struct Malformed
+    {
+    };
+
+    /// Decodes what Writer produced into the arena of an Ast whose tokens
+    /// have already been restored.
+    class Reader
+    {
+    public:
+        Reader(const char *cursor_, const char *end_, Ast &ast_, Heap &heap_)
+            : cursor(cursor_), end(end_), ast(ast_), heap(heap_) {}
+
+        template <typename T>
+        T get()
+        {
+            if (static_cast<size_t>(end - cursor) < sizeof(T))
+                throw Malformed();
+
+            T value;
+            std::memcpy(&value, cursor, sizeof(T));
+            cursor += sizeof(T);
+            return value;
+        }
+
+        bool atEnd() const { return cursor == end; }
+
+        StmtList statements()
+        {
+            uint32_t count = get<uint32_t>();
+            StmtList list;
+            list.reserve(count < 1024 ? count : 1024);
+            for (uint32_t i = 0; i < count; i++)
+                list.push_back(stmt());
+            return list;
+        }
+
+        /// A child the Writer always emits.
+        Expr *expr()
+        {
+            Expr *node = optionalExpr();
+            if (!node)
+                throw Malformed();
+            return node;
+        }
+
+        /// A child that may be missing, such as a `for` clause.
+        Expr *optionalExpr()
+        {
+            uint8_t tag = get<uint8_t>();
+            if (tag == NULL_TAG)
+                return nullptr;
+            uint32_t line = get<uint32_t>();
+            Nesting nesting(*this);
+
+            Expr *node;
+            switch (static_cast<ExprType>(tag))
+            {
+            case ExprType::AssignExprType:
+            {
+                TokenPtr name = identifier();
+                node = make<AssignExpr>(name, expr());
+                break;
+            }
+            case ExprType::BinaryExprType:
+            {
+                Expr *left = expr();
+                TokenPtr op = token();
+                node = make<BinaryExpr>(left, op, expr());
+                break;
+            }
+            case ExprType::CallExprType:
+            {
+                Expr *callee = expr();
+                uint32_t count = get<uint32_t>();
+                std::vector<Expr *> arguments;
+                for (uint32_t i = 0; i < count; i++)
+                    arguments.push_back(expr());
+                node = make<CallExpr>(callee, std::move(arguments));
+                break;
+            }
+            case ExprType::GroupExprType:
+                node = make<GroupingExpr>(expr());
+                break;
+            case ExprType::NilLiteralExprType:
+                node = make<NilLiteralExpr>();
+                break;
+            case ExprType::BoolLiteralExprType:
+                node = make<BoolLiteralExpr>(get<uint8_t>() != 0);
+                break;
+            case ExprType::NumLiteralExprType:
+                node = make<NumLiteralExpr>(get<double>());
+                break;
+            case ExprType::StrLiteralExprType:
+            {
+                uint32_t length = get<uint32_t>();
+                if (static_cast<size_t>(end - cursor) < length)
+                    throw Malformed();
+                node = make<StrLiteralExpr>(heap.internPinned(cursor, length));
+                cursor += length;
+                break;
+            }
+            case ExprType::LogicalExprType:
+            {
+                Expr *left = expr();
+                TokenPtr opr = token();
+                node = make<LogicExpr>(left, opr, expr());
+                break;
+            }
+            case ExprType::UnaryExprType:
+            {
+                TokenPtr op = token();
+                node = make<UnaryExpr>(op, expr());
+                break;
+            }
+            case ExprType::VarExprType:
+                node = make<VarExpr>(identifier());
+                break;
+            default:
+                throw Malformed();
+            }
+
+            node->line = line;
+            return node;
+        }
+
+        Stmt *stmt()
+        {
+            Stmt *node = optionalStmt();
+            if (!node)
+                throw Malformed();
+            return node;
+        }
+
+        Stmt *optionalStmt()
+        {
+            uint8_t tag = get<uint8_t>();
+            if (tag == NULL_TAG)
+                return nullptr;
+            uint32_t line = get<uint32_t>();
+            Nesting nesting(*this);
+
+            Stmt *node;
+            switch (static_cast<StmtType>(tag))
+            {
+            case StmtType::BlockStmtType:
+                node = make<BlockStmt>(statements());
+                break;
+            case StmtType::ExprStmtType:
+                node = make<ExprStmt>(expr());
+                break;
+            case StmtType::FuncStmtType:
+            {
+                TokenPtr name = identifier();
+                uint32_t count = get<uint32_t>();
+                ParamList params;
+                for (uint32_t i = 0; i < count; i++)
+                    params.push_back(identifier());
+                node = make<FuncStmt>(name, std::move(params), statements());
+                break;
+            }
+            case StmtType::IfStmtType:
+            {
+                Expr *condition = expr();
+                Stmt *thenBranch = stmt();
+                node = make<IfStmt>(condition, thenBranch, optionalStmt());
+                break;
+            }
+            case StmtType::PrintStmtType:
+                node = make<PrintStmt>(expr());
+                break;
+            case StmtType::ReturnStmtType:
+            {
+                TokenPtr keyword = token();
+                node = make<ReturnStmt>(keyword, optionalExpr());
+                break;
+            }
+            case StmtType::VarStmtType:
+            {
+                TokenPtr name = identifier();
+                node = make<VarStmt>(name, optionalExpr());
+                break;
+            }
+            case StmtType::WhileStmtType:
+            {
+                Expr *condition = expr();
+                Stmt *body = stmt();
+                node = make<WhileStmt>(condition, body, optionalExpr());
+                break;
+            }
+            default:
+                throw Malformed();
+            }
+
+            node->line = line;
+            return node;
+        }
+
+    private:
+        /// Deepest a tree may nest, so a hostile file cannot exhaust the
+        /// native stack. Deeper trees are parsed from source instead.
+        static const size_t MAX_NESTING = 10000;
+
+        const char *cursor;
+        const char *end;
+        Ast &ast;
+        Heap &heap;
+        size_t nesting = 0;
+
+        /// Counts one level of nesting while in scope.
+        struct Nesting
+        {
+            Reader &reader;
+
+            Nesting(Reader &reader_) : reader(reader_)
+            {
+                if (reader.nesting == MAX_NESTING)
+                    throw Malformed();
+                reader.nesting++;
+            }
+            ~Nesting() { reader.nesting--; }
+        };
+
+        TokenPtr token()
+        {
+            uint32_t index = get<uint32_t>();
+            if (index >= ast.tokens.size())
+                throw Malformed();
+            return &ast.tokens[index];
+        }
+
+        /// A name or parameter, which the resolver and global caches look up
+        /// by the interned string only identifiers carry.
+        TokenPtr identifier()
+        {
+            TokenPtr name = token();
+            if (name->type != TokenType::IDENTIFIER)
+                throw Malformed();
+            return name;
+        }
+
+        template <typename T, typename... Args>
+        T *make(Args &&... args)
+        {
+            return ast.arena.make<T>(std::forward<Args>(args)...);
+        }
+    };
+} // namespace
+
+std::string AstCache::pathFor(const std::string &scriptPath, const std::string &dir)
+{
+    if (dir.empty())
+        return scriptPath + ".cache";
+
+    char resolved[PATH_MAX];
+    std::string absolute = realpath(scriptPath.c_str(), resolved) ? resolved : scriptPath;
+
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.cache", static_cast<unsigned long long>(hash(absolute.data(), absolute.size())));
+    return dir + "/" + name;
+}
+
+bool AstCache::load(const std::string &path, Ast &ast, Heap &heap)
+{
+    SourceBuffer file;
+    if (buildId() == 0 || !file.open(path) || file.size() < sizeof(Header))
+        return false;
+
+    Header header;
+    std::memcpy(&header, file.data(), sizeof(Header));
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.build != buildId() ||
+        header.sourceSize != ast.source.size() || header.sourceHash != hash(ast.source.data(), ast.source.size()))
+        return false;
+
+    const char *cursor = file.data() + sizeof(Header);
+    const char *end = file.data() + file.size();
+    if (static_cast<size_t>(end - cursor) / sizeof(CachedToken) < header.tokenCount)
+        return false;
+
+    // Reserved up front: nodes point into the list.
+    ast.tokens.reserve(header.tokenCount);
+    for (uint32_t i = 0; i < header.tokenCount; i++, cursor += sizeof(CachedToken))
+    {
+        CachedToken cached;
+        std::memcpy(&cached, cursor, sizeof(CachedToken));
+        if (cached.type > static_cast<uint32_t>(TokenType::END_OF_FILE) ||
+            cached.offset > ast.source.size() || cached.length > ast.source.size() - cached.offset)
+        {
+            ast.tokens.clear();
+            return false;
+        }
+
+        const char *start = ast.source.data() + cached.offset;
+        ast.tokens.emplace_back(static_cast<TokenType>(cached.type), start, cached.length, cached.line);
+        if (ast.tokens.back().type == TokenType::IDENTIFIER)
+            ast.tokens.back().literal.string = heap.internPinned(start, cached.length);
+    }
+
+    Reader reader(cursor, end, ast, heap);
+    try
+    {
+        ast.statements = reader.statements();
+        if (reader.atEnd())
+            return true;
+    }
+    catch (Malformed &)
+    {
+    }
+
+    ast.tokens.clear();
+    ast.statements.clear();
+    return false;
+}
+
+bool AstCache::save(const std::string &path, const Ast &ast)
+{
+    Writer writer(ast.source);
+    writer.add(ast.statements);
+    if (!writer.ok || ast.source.size() > UINT32_MAX || buildId() == 0)
+        return false;
+
+    Header header;
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.tokenCount = static_cast<uint32_t>(writer.tokens.size());
+    header.build = buildId();
+    header.sourceHash = hash(ast.source.data(), ast.source.size());
+    header.sourceSize = ast.source.size();
+
+    std::string temp = path + ".tmp" + std::to_string(getpid());
+    {
+        std::ofstream file(temp, std::ios::binary);
+        file.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+        for (TokenPtr token : writer.tokens)
+        {
+            CachedToken cached = {static_cast<uint32_t>(token->start - ast.source.data()), token->length,
+                                  token->line, static_cast<uint32_t>(token->type)};
+            file.write(reinterpret_cast<const char *>(&cached), sizeof(CachedToken));
+        }
+        file.write(writer.nodes.data(), writer.nodes.size());
+        if (!file)
+        {
+            std::remove(temp.c_str());
+            return false;
+        }
+    }
+
+    if (std::rename(temp.c_str(), path.c_str()) != 0)
+    {
+        std::remove(temp.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,41 @@
+#ifndef CACHE_HPP
+#define CACHE_HPP
+
+#include <cstdint>
+#include <string>
+
+#include "heap.hpp"
+#include "parser.hpp"
+
+namespace lox
+{
+
+    /// On-disk copy of a parsed program, so an unchanged script skips
+    /// scanning and parsing. The file holds the tokens the tree refers to,
+    /// as offsets into the source, followed by the tree itself in pre-order.
+    /// It is keyed by a hash of the source and by the build of the
+    /// interpreter that wrote it, and is mapped rather than read when loaded.
+    ///
+    /// Only freshly parsed trees are saved: the resolver and optimizer run
+    /// again after every load.
+    class AstCache
+    {
+    public:
+        /// The cache file for the script at `scriptPath`: next to it when
+        /// `dir` is empty, otherwise in `dir` under a name derived from the
+        /// script's absolute path.
+        static std::string pathFor(const std::string &scriptPath, const std::string &dir);
+
+        /// Fills `ast.tokens` and `ast.statements` from the cache file at
+        /// `path`. Returns false, leaving both empty, if the file is
+        /// missing, stale or malformed.
+        static bool load(const std::string &path, Ast &ast, Heap &heap);
+
+        /// Writes `ast`, which must be freshly parsed without errors. The
+        /// file is replaced atomically, so a concurrent load never sees a
+        /// partial one. Returns false if it could not be written.
+        static bool save(const std::string &path, const Ast &ast);
+    };
+} // namespace lox
+
+#endif
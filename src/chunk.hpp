@@ -0,0 +1,147 @@
+#ifndef CHUNK_HPP
+#define CHUNK_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "object.hpp"
+
+namespace lox
+{
+
+    enum class OpCode : uint8_t
+    {
+        CONSTANT,
+        NIL,
+        TRUE,
+        FALSE,
+        POP,
+        GET_LOCAL,
+        SET_LOCAL,
+        GET_GLOBAL,
+        DEFINE_GLOBAL,
+        SET_GLOBAL,
+        GET_UPVALUE,
+        SET_UPVALUE,
+        EQUAL,
+        NOT_EQUAL,
+        GREATER,
+        GREATER_EQUAL,
+        LESS,
+        LESS_EQUAL,
+        ADD,
+        SUBTRACT,
+        MULTIPLY,
+        DIVIDE,
+        NOT,
+        NEGATE,
+        PRINT,
+        JUMP,
+        JUMP_IF_FALSE,
+        LOOP,
+        CALL,
+        TAIL_CALL,
+        CLOSURE,
+        CLOSE_UPVALUE,
+        RETURN,
+    };
+
+    /// A flat sequence of bytecode for one function. Constant and jump
+    /// operands are 16 bits wide, big-endian; local and upvalue indices are
+    /// one byte.
+    class Chunk
+    {
+    public:
+        std::vector<uint8_t> code;
+        std::vector<size_t> lines;
+        std::vector<Value> constants;
+
+        /// Inline cache for global accesses, parallel to `constants`: the
+        /// VM's slot for the global named by each constant, once found.
+        std::vector<Value *> globalSlots;
+
+        void write(uint8_t byte, size_t line)
+        {
+            code.push_back(byte);
+            lines.push_back(line);
+        }
+
+        void write(OpCode op, size_t line)
+        {
+            write(static_cast<uint8_t>(op), line);
+        }
+
+        size_t addConstant(Value value)
+        {
+            constants.push_back(std::move(value));
+            globalSlots.push_back(nullptr);
+            return constants.size() - 1;
+        }
+    };
+
+    /// A compiled function body. Prototypes are owned by the VM and shared
+    /// by every closure created from them.
+    struct FunctionProto
+    {
+        std::string name;
+        size_t line = 0;
+        int arity = 0;
+        int upvalueCount = 0;
+        Chunk chunk;
+
+        /// The most stack slots a call uses at once: the closure, arguments,
+        /// locals and temporaries. The VM makes room for them on entry.
+        size_t maxStack = 0;
+
+        /// Index into the VM's prototype table, used by OP_CLOSURE.
+        size_t index = 0;
+    };
+
+    /// A captured variable. While open it points into the VM stack; once the
+    /// owning frame's slot goes out of scope the value moves into `closed`.
+    class Upvalue : public Object
+    {
+    public:
+        Value *location;
+        Value closed;
+
+        Upvalue(Value *location_) : Object(ObjectType::UpvalueType), location(location_), closed() {}
+
+        void trace(Heap &heap) override;
+
+        size_t size() const override { return sizeof(Upvalue); }
+
+        bool equals(Object *other) const override { return other == this; }
+
+        std::string toString() const override { return "<upvalue>"; }
+    };
+
+    class ClosureObj : public Object
+    {
+    public:
+        FunctionProto *function;
+        std::vector<Upvalue *> upvalues;
+
+        ClosureObj(FunctionProto *function_) : Object(ObjectType::ClosureType),
+                                               function(function_),
+                                               upvalues(function_->upvalueCount, nullptr) {}
+
+        void trace(Heap &heap) override;
+
+        size_t size() const override { return sizeof(ClosureObj) + upvalues.capacity() * sizeof(Upvalue *); }
+
+        bool isTrue() const override { return false; }
+
+        bool equals(Object *other) const override { return other->type == ObjectType::ClosureType; }
+
+        std::string toString() const override
+        {
+            return "<fn " + function->name + ">";
+        }
+    };
+
+} // namespace lox
+
+#endif
@@ -0,0 +1,582 @@
+#include "compiler.hpp"
+
+using namespace lox;
+
+FunctionProto *Compiler::compile(StmtList &statements)
+{
+    FunctionState state;
+    beginFunction(state, newFunction("script"));
+
+    for (auto &stmt : statements)
+        compile(stmt);
+
+    emit(OpCode::NIL);
+    emit(OpCode::RETURN);
+
+    current = state.enclosing;
+    return state.function;
+}
+
+FunctionProto *Compiler::newFunction(const std::string &name)
+{
+    functions.push_back(std::unique_ptr<FunctionProto>(new FunctionProto()));
+    FunctionProto *function = functions.back().get();
+    function->name = name;
+    function->index = functions.size() - 1;
+    return function;
+}
+
+void Compiler::beginFunction(FunctionState &state, FunctionProto *function)
+{
+    state.enclosing = current;
+    state.function = function;
+    state.scopeDepth = 0;
+    state.stackDepth = 0;
+
+    // Slot zero holds the closure being called.
+    state.locals.push_back({nullptr, 0, false});
+    current = &state;
+    adjustStack(1);
+}
+
+void Compiler::compileFunction(FuncStmt *stmt)
+{
+    FunctionState state;
+    beginFunction(state, newFunction(stmt->name->lexeme()));
+    state.function->line = stmt->name->line;
+    beginScope();
+
+    state.function->arity = static_cast<int>(stmt->params.size());
+    for (auto &param : stmt->params)
+    {
+        declareVariable(param);
+        defineVariable(param);
+    }
+    adjustStack(state.function->arity);
+
+    for (auto &bodyStmt : stmt->body)
+        compile(bodyStmt);
+
+    emit(OpCode::NIL);
+    emit(OpCode::RETURN);
+
+    current = state.enclosing;
+
+    FunctionProto *function = state.function;
+    function->upvalueCount = static_cast<int>(state.upvalues.size());
+    emitShort(OpCode::CLOSURE, static_cast<uint16_t>(function->index));
+    for (auto &upvalue : state.upvalues)
+    {
+        emit(upvalue.isLocal ? 1 : 0);
+        emit(upvalue.index);
+    }
+}
+
+void Compiler::compile(Stmt *stmt)
+{
+    if (stmt)
+        stmt->accept(*this);
+}
+
+void Compiler::compile(Expr *expr)
+{
+    if (expr)
+        expr->accept(*this);
+    else
+        emit(OpCode::NIL);
+}
+
+void Compiler::emit(uint8_t byte)
+{
+    chunk().write(byte, line);
+}
+
+/// How many values an instruction pushes, less the ones it pops. A call
+/// also pops the arguments given by its operand.
+static int stackEffect(OpCode op)
+{
+    switch (op)
+    {
+    case OpCode::CONSTANT:
+    case OpCode::NIL:
+    case OpCode::TRUE:
+    case OpCode::FALSE:
+    case OpCode::GET_LOCAL:
+    case OpCode::GET_GLOBAL:
+    case OpCode::GET_UPVALUE:
+    case OpCode::CLOSURE:
+        return 1;
+    case OpCode::POP:
+    case OpCode::DEFINE_GLOBAL:
+    case OpCode::EQUAL:
+    case OpCode::NOT_EQUAL:
+    case OpCode::GREATER:
+    case OpCode::GREATER_EQUAL:
+    case OpCode::LESS:
+    case OpCode::LESS_EQUAL:
+    case OpCode::ADD:
+    case OpCode::SUBTRACT:
+    case OpCode::MULTIPLY:
+    case OpCode::DIVIDE:
+    case OpCode::PRINT:
+    case OpCode::CLOSE_UPVALUE:
+    case OpCode::RETURN:
+        return -1;
+    default:
+        return 0;
+    }
+}
+
+void Compiler::emit(OpCode op)
+{
+    chunk().write(op, line);
+    adjustStack(stackEffect(op));
+}
+
+void Compiler::emit(OpCode op, uint8_t operand)
+{
+    emit(op);
+    emit(operand);
+    if (op == OpCode::CALL || op == OpCode::TAIL_CALL)
+        adjustStack(-operand);
+}
+
+void Compiler::adjustStack(int delta)
+{
+    current->stackDepth += delta;
+    if (current->stackDepth > 0 && static_cast<size_t>(current->stackDepth) > current->function->maxStack)
+        current->function->maxStack = static_cast<size_t>(current->stackDepth);
+}
+
+void Compiler::emitShort(OpCode op, uint16_t operand)
+{
+    emit(op);
+    emit(static_cast<uint8_t>(operand >> 8));
+    emit(static_cast<uint8_t>(operand & 0xff));
+}
+
+size_t Compiler::emitJump(OpCode op)
+{
+    emitShort(op, 0xffff);
+    size_t offset = chunk().code.size() - 2;
+    current->jumpDepths[offset] = current->stackDepth;
+    return offset;
+}
+
+void Compiler::patchJump(size_t offset)
+{
+    size_t jump = chunk().code.size() - offset - 2;
+    if (jump > UINT16_MAX)
+        error("Too much code to jump over.");
+
+    chunk().code[offset] = static_cast<uint8_t>((jump >> 8) & 0xff);
+    chunk().code[offset + 1] = static_cast<uint8_t>(jump & 0xff);
+
+    // Code is only compiled straight through, so the target either follows
+    // an unconditional jump or loop, or is reached with the same depth by
+    // both paths. Either way the jump's depth is the one that holds there.
+    auto it = current->jumpDepths.find(offset);
+    current->stackDepth = it->second;
+    current->jumpDepths.erase(it);
+}
+
+void Compiler::emitLoop(size_t loopStart)
+{
+    size_t offset = chunk().code.size() - loopStart + 3;
+    if (offset > UINT16_MAX)
+        error("Loop body too large.");
+
+    emitShort(OpCode::LOOP, static_cast<uint16_t>(offset));
+}
+
+uint16_t Compiler::makeConstant(Value value)
+{
+    size_t constant = chunk().addConstant(std::move(value));
+    if (constant > UINT16_MAX)
+    {
+        error("Too many constants in one chunk.");
+        return 0;
+    }
+    return static_cast<uint16_t>(constant);
+}
+
+uint16_t Compiler::nameConstant(StrObj *name)
+{
+    auto it = current->names.find(name);
+    if (it != current->names.end())
+        return it->second;
+
+    uint16_t constant = makeConstant(Value(name));
+    current->names[name] = constant;
+    return constant;
+}
+
+void Compiler::emitBinary(TokenType op)
+{
+    switch (op)
+    {
+    case TokenType::GREATER:
+        emit(OpCode::GREATER);
+        break;
+    case TokenType::GREATER_EQUAL:
+        emit(OpCode::GREATER_EQUAL);
+        break;
+    case TokenType::LESS:
+        emit(OpCode::LESS);
+        break;
+    case TokenType::LESS_EQUAL:
+        emit(OpCode::LESS_EQUAL);
+        break;
+    case TokenType::BANG_EQUAL:
+        emit(OpCode::NOT_EQUAL);
+        break;
+    case TokenType::EQUAL_EQUAL:
+        emit(OpCode::EQUAL);
+        break;
+    case TokenType::MINUS:
+        emit(OpCode::SUBTRACT);
+        break;
+    case TokenType::PLUS:
+        emit(OpCode::ADD);
+        break;
+    case TokenType::SLASH:
+        emit(OpCode::DIVIDE);
+        break;
+    case TokenType::STAR:
+        emit(OpCode::MULTIPLY);
+        break;
+    default:
+        break;
+    }
+}
+
+void Compiler::getVariable(StrObj *name)
+{
+    int arg = resolveLocal(current, name);
+    if (arg != -1)
+        emit(OpCode::GET_LOCAL, static_cast<uint8_t>(arg));
+    else if ((arg = resolveUpvalue(current, name)) != -1)
+        emit(OpCode::GET_UPVALUE, static_cast<uint8_t>(arg));
+    else
+        emitShort(OpCode::GET_GLOBAL, nameConstant(name));
+}
+
+void Compiler::setVariable(StrObj *name)
+{
+    int arg = resolveLocal(current, name);
+    if (arg != -1)
+        emit(OpCode::SET_LOCAL, static_cast<uint8_t>(arg));
+    else if ((arg = resolveUpvalue(current, name)) != -1)
+        emit(OpCode::SET_UPVALUE, static_cast<uint8_t>(arg));
+    else
+        emitShort(OpCode::SET_GLOBAL, nameConstant(name));
+}
+
+void Compiler::beginScope()
+{
+    current->scopeDepth++;
+}
+
+void Compiler::endScope()
+{
+    current->scopeDepth--;
+
+    auto &locals = current->locals;
+    while (!locals.empty() && locals.back().depth > current->scopeDepth)
+    {
+        emit(locals.back().isCaptured ? OpCode::CLOSE_UPVALUE : OpCode::POP);
+        locals.pop_back();
+    }
+}
+
+void Compiler::addLocal(StrObj *name)
+{
+    if (current->locals.size() > UINT8_MAX)
+    {
+        error("Too many local variables in function.");
+        return;
+    }
+
+    // Depth -1 marks the local as declared but not yet initialized.
+    current->locals.push_back({name, -1, false});
+}
+
+int Compiler::resolveLocal(FunctionState *state, StrObj *name)
+{
+    for (int i = static_cast<int>(state->locals.size()) - 1; i >= 0; i--)
+    {
+        if (state->locals[i].depth != -1 && state->locals[i].name == name)
+            return i;
+    }
+    return -1;
+}
+
+int Compiler::addUpvalue(FunctionState *state, uint8_t index, bool isLocal)
+{
+    for (size_t i = 0; i < state->upvalues.size(); i++)
+    {
+        if (state->upvalues[i].index == index && state->upvalues[i].isLocal == isLocal)
+            return static_cast<int>(i);
+    }
+
+    if (state->upvalues.size() > UINT8_MAX)
+    {
+        error("Too many closure variables in function.");
+        return 0;
+    }
+
+    state->upvalues.push_back({index, isLocal});
+    return static_cast<int>(state->upvalues.size()) - 1;
+}
+
+int Compiler::resolveUpvalue(FunctionState *state, StrObj *name)
+{
+    if (state->enclosing == nullptr)
+        return -1;
+
+    int local = resolveLocal(state->enclosing, name);
+    if (local != -1)
+    {
+        state->enclosing->locals[local].isCaptured = true;
+        return addUpvalue(state, static_cast<uint8_t>(local), true);
+    }
+
+    int upvalue = resolveUpvalue(state->enclosing, name);
+    if (upvalue != -1)
+        return addUpvalue(state, static_cast<uint8_t>(upvalue), false);
+
+    return -1;
+}
+
+void Compiler::declareVariable(const Token *name)
+{
+    line = name->line;
+    if (current->scopeDepth == 0)
+        return;
+    addLocal(name->literal.string);
+}
+
+void Compiler::defineVariable(const Token *name)
+{
+    if (current->scopeDepth > 0)
+    {
+        current->locals.back().depth = current->scopeDepth;
+        return;
+    }
+    emitShort(OpCode::DEFINE_GLOBAL, nameConstant(name->literal.string));
+}
+
+void Compiler::error(const std::string &message)
+{
+    errorhandler.add(line, "", message);
+}
+
+/*****************************************/
+// Statements
+
+void Compiler::visit(BlockStmt *stmt)
+{
+    beginScope();
+    for (auto &inner : stmt->statements)
+        compile(inner);
+    endScope();
+}
+
+void Compiler::visit(ExprStmt *stmt)
+{
+    compile(stmt->expression);
+    emit(OpCode::POP);
+}
+
+void Compiler::visit(FuncStmt *stmt)
+{
+    declareVariable(stmt->name);
+    // A function may refer to itself, so it is initialized before its body
+    // is compiled.
+    if (current->scopeDepth > 0)
+        current->locals.back().depth = current->scopeDepth;
+    compileFunction(stmt);
+    defineVariable(stmt->name);
+}
+
+void Compiler::visit(IfStmt *stmt)
+{
+    compile(stmt->condition);
+
+    size_t thenJump = emitJump(OpCode::JUMP_IF_FALSE);
+    emit(OpCode::POP);
+    compile(stmt->thenBranch);
+
+    size_t elseJump = emitJump(OpCode::JUMP);
+    patchJump(thenJump);
+    emit(OpCode::POP);
+    compile(stmt->elseBranch);
+    patchJump(elseJump);
+}
+
+void Compiler::visit(PrintStmt *stmt)
+{
+    compile(stmt->expression);
+    emit(OpCode::PRINT);
+}
+
+void Compiler::visit(ReturnStmt *stmt)
+{
+    line = stmt->keyword->line;
+    if (stmt->value != nullptr && stmt->value->type == ExprType::CallExprType)
+    {
+        auto *call = static_cast<CallExpr *>(stmt->value);
+        compile(call->callee);
+        for (auto &arg : call->arguments)
+            compile(arg);
+        emit(OpCode::TAIL_CALL, static_cast<uint8_t>(call->arguments.size()));
+    }
+    else
+        compile(stmt->value);
+    emit(OpCode::RETURN);
+}
+
+void Compiler::visit(VarStmt *stmt)
+{
+    declareVariable(stmt->name);
+    compile(stmt->initializer);
+    defineVariable(stmt->name);
+}
+
+void Compiler::visit(WhileStmt *stmt)
+{
+    size_t loopStart = chunk().code.size();
+    compile(stmt->condition);
+
+    size_t exitJump = emitJump(OpCode::JUMP_IF_FALSE);
+    emit(OpCode::POP);
+    compile(stmt->body);
+    if (stmt->increment)
+    {
+        compile(stmt->increment);
+        emit(OpCode::POP);
+    }
+    emitLoop(loopStart);
+
+    patchJump(exitJump);
+    emit(OpCode::POP);
+}
+
+/*****************************************/
+// Expressions
+
+void Compiler::visit(AssignExpr *expr)
+{
+    compile(expr->value);
+    line = expr->name->line;
+    setVariable(expr->name->literal.string);
+}
+
+void Compiler::visit(BinaryExpr *expr)
+{
+    compile(expr->left);
+    compile(expr->right);
+    line = expr->op->line;
+
+    emitBinary(expr->op->type);
+}
+
+void Compiler::visit(CallExpr *expr)
+{
+    compile(expr->callee);
+    for (auto &arg : expr->arguments)
+        compile(arg);
+    emit(OpCode::CALL, static_cast<uint8_t>(expr->arguments.size()));
+}
+
+void Compiler::visit(GroupingExpr *expr)
+{
+    compile(expr->expression);
+}
+
+void Compiler::visit(NilLiteralExpr *)
+{
+    emit(OpCode::NIL);
+}
+
+void Compiler::visit(BoolLiteralExpr *expr)
+{
+    emit(expr->literal ? OpCode::TRUE : OpCode::FALSE);
+}
+
+void Compiler::visit(StrLiteralExpr *expr)
+{
+    emitShort(OpCode::CONSTANT, makeConstant(Value(expr->literal)));
+}
+
+void Compiler::visit(NumLiteralExpr *expr)
+{
+    emitShort(OpCode::CONSTANT, makeConstant(Value(expr->literal)));
+}
+
+void Compiler::visit(LogicExpr *expr)
+{
+    // Like the tree-walker, a short-circuited operand yields a bool rather
+    // than the operand itself.
+    compile(expr->left);
+    line = expr->opr->line;
+
+    size_t shortJump = emitJump(OpCode::JUMP_IF_FALSE);
+    emit(OpCode::POP);
+    if (expr->opr->type == TokenType::OR)
+        emit(OpCode::TRUE);
+    else
+        compile(expr->right);
+
+    size_t endJump = emitJump(OpCode::JUMP);
+    patchJump(shortJump);
+    emit(OpCode::POP);
+    if (expr->opr->type == TokenType::OR)
+        compile(expr->right);
+    else
+        emit(OpCode::FALSE);
+    patchJump(endJump);
+}
+
+void Compiler::visit(UnaryExpr *expr)
+{
+    compile(expr->right);
+    line = expr->op->line;
+
+    switch (expr->op->type)
+    {
+    case TokenType::BANG:
+        emit(OpCode::NOT);
+        break;
+    case TokenType::MINUS:
+        emit(OpCode::NEGATE);
+        break;
+    default:
+        break;
+    }
+}
+
+void Compiler::visit(VarExpr *expr)
+{
+    line = expr->name->line;
+    getVariable(expr->name->literal.string);
+}
+
+void Compiler::visit(AddAssignExpr *expr)
+{
+    line = expr->name->line;
+    getVariable(expr->name->literal.string);
+    compile(expr->operand);
+    line = expr->name->line;
+    emit(OpCode::ADD);
+    setVariable(expr->name->literal.string);
+}
+
+void Compiler::visit(CompareConstExpr *expr)
+{
+    line = expr->name->line;
+    getVariable(expr->name->literal.string);
+    emitShort(OpCode::CONSTANT, makeConstant(Value(expr->constant)));
+    line = expr->op->line;
+    emitBinary(expr->op->type);
+}
@@ -0,0 +1,131 @@
+#ifndef COMPILER_HPP
+#define COMPILER_HPP
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ast.hpp"
+#include "chunk.hpp"
+#include "heap.hpp"
+#include "parser.hpp"
+#include "error_handler.hpp"
+
+namespace lox
+{
+
+    using ProtoList = std::vector<std::unique_ptr<FunctionProto>>;
+
+    /// Lowers a parsed StmtList into bytecode for the VM. Each FuncStmt
+    /// becomes its own FunctionProto appended to `functions`; the returned
+    /// prototype is the top-level script.
+    class Compiler : public ExprVisitor, StmtVisitor
+    {
+    public:
+        /// Prototypes go straight into `functions`, which must be a table the
+        /// collector roots (the VM's), since constants are allocated as we go.
+        Compiler(ProtoList &functions_, Heap &heap_, ErrorHandler &errorhandler_)
+            : functions(functions_), heap(heap_), errorhandler(errorhandler_) {}
+
+        FunctionProto *compile(StmtList &statements);
+
+    private:
+        struct Local
+        {
+            StrObj *name;
+            int depth;
+            bool isCaptured;
+        };
+
+        struct UpvalueRef
+        {
+            uint8_t index;
+            bool isLocal;
+        };
+
+        struct FunctionState
+        {
+            FunctionState *enclosing;
+            FunctionProto *function;
+            std::vector<Local> locals;
+            std::vector<UpvalueRef> upvalues;
+            std::unordered_map<StrObj *, uint16_t> names;
+            int scopeDepth;
+
+            /// Values on the stack at the current point of the code, and at
+            /// each forward jump not yet patched, keyed by its operand.
+            int stackDepth;
+            std::unordered_map<size_t, int> jumpDepths;
+        };
+
+        ProtoList &functions;
+        Heap &heap;
+        ErrorHandler &errorhandler;
+        FunctionState *current = nullptr;
+        size_t line = 1;
+
+        FunctionProto *newFunction(const std::string &name);
+        void beginFunction(FunctionState &state, FunctionProto *function);
+        void compileFunction(FuncStmt *stmt);
+
+        void compile(Stmt *stmt);
+        void compile(Expr *expr);
+
+        Chunk &chunk() { return current->function->chunk; }
+        void emit(uint8_t byte);
+        void emit(OpCode op);
+        void emit(OpCode op, uint8_t operand);
+        void emitShort(OpCode op, uint16_t operand);
+        size_t emitJump(OpCode op);
+        void patchJump(size_t offset);
+        void emitLoop(size_t loopStart);
+
+        /// Accounts for `delta` values pushed or popped by the code just
+        /// emitted, raising the function's maxStack.
+        void adjustStack(int delta);
+        uint16_t makeConstant(Value value);
+        uint16_t nameConstant(StrObj *name);
+        void emitBinary(TokenType op);
+        void getVariable(StrObj *name);
+        void setVariable(StrObj *name);
+
+        void beginScope();
+        void endScope();
+        void addLocal(StrObj *name);
+        int resolveLocal(FunctionState *state, StrObj *name);
+        int resolveUpvalue(FunctionState *state, StrObj *name);
+        int addUpvalue(FunctionState *state, uint8_t index, bool isLocal);
+        void declareVariable(const Token *name);
+        void defineVariable(const Token *name);
+
+        void error(const std::string &message);
+
+        /// Expressions.
+        void visit(AssignExpr *expr) override;
+        void visit(BinaryExpr *expr) override;
+        void visit(CallExpr *expr) override;
+        void visit(GroupingExpr *expr) override;
+        void visit(NilLiteralExpr *expr) override;
+        void visit(BoolLiteralExpr *expr) override;
+        void visit(StrLiteralExpr *expr) override;
+        void visit(NumLiteralExpr *expr) override;
+        void visit(LogicExpr *expr) override;
+        void visit(UnaryExpr *expr) override;
+        void visit(VarExpr *expr) override;
+        void visit(AddAssignExpr *expr) override;
+        void visit(CompareConstExpr *expr) override;
+
+        /// Statements.
+        void visit(BlockStmt *stmt) override;
+        void visit(ExprStmt *stmt) override;
+        void visit(FuncStmt *stmt) override;
+        void visit(IfStmt *stmt) override;
+        void visit(PrintStmt *stmt) override;
+        void visit(ReturnStmt *stmt) override;
+        void visit(VarStmt *stmt) override;
+        void visit(WhileStmt *stmt) override;
+    };
+} // namespace lox
+
+#endif
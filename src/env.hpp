@@ -1,57 +1,120 @@
 #ifndef ENV_HPP
 #define ENV_HPP
 
+#include <cstdint>
+#include <memory>
 #include <unordered_map>
+#include <vector>
+
+#include "object.hpp"
 
 namespace lox
 {
 
-    class Object;
-
-    class Env
+    /// A local scope. Variables are addressed by the (depth, slot) pair the
+    /// Resolver computed, so lookups never hash a name. Envs are heap
+    /// objects so that closures capturing them are traced by the collector.
+    class Env : public Object
     {
-        std::shared_ptr<Env> enclosing;
-        std::unordered_map<std::string, std::unique_ptr<Object>> values;
+    public:
+        Env *enclosing;
+        std::vector<Value> slots;
+
+        Env(Env *enclosing_, size_t size_) : Object(ObjectType::EnvType), enclosing(enclosing_), slots(size_) {}
+
+        void trace(Heap &heap) override;
+
+        size_t size() const override { return sizeof(Env) + slots.capacity() * sizeof(Value); }
+
+        bool equals(Object *other) const override { return other == this; }
+
+        std::string toString() const override { return "<env>"; }
 
+        Env *ancestor(int depth)
+        {
+            Env *env = this;
+            while (depth-- > 0)
+                env = env->enclosing;
+            return env;
+        }
+
+        Value &at(int depth, int slot)
+        {
+            return ancestor(depth)->slots[slot];
+        }
+    };
+
+    /// The global scope stays name-based: globals may be referenced before
+    /// they are declared, and the REPL keeps adding to it line by line.
+    /// Names are interned, so the map hashes and compares pointers.
+    ///
+    /// Map nodes never move and globals are only removed by reset(), so a
+    /// pointer to a value stays valid until then; inline caches rely on
+    /// this and tag their entries with `id`.
+    class GlobalEnv
+    {
     public:
-        Env() : enclosing(nullptr) {}
+        uint32_t id;
+        std::unordered_map<StrObj *, Value> values;
 
-        Env(std::shared_ptr<Env> enclosing_) : enclosing(enclosing_) {}
+        GlobalEnv() : id(nextId()) {}
 
-        void define(const std::string &name, std::unique_ptr<Object> value)
+        /// Drops every global except the natives and takes a new id, so
+        /// entries cached against the old values miss.
+        void reset()
+        {
+            for (auto it = values.begin(); it != values.end();)
+            {
+                if (it->second.isNative())
+                    ++it;
+                else
+                    it = values.erase(it);
+            }
+            id = nextId();
+        }
+
+        void define(StrObj *name, Value value)
         {
             values[name] = std::move(value);
         }
 
-        void assign(const std::string &name, std::unique_ptr<Object> value)
+        Value *get(StrObj *name)
         {
             auto it = values.find(name);
             if (it != values.end())
+                return &it->second;
+
+            return nullptr;
+        }
+
+        /// get() through an inline cache.
+        Value *get(StrObj *name, GlobalCache &cache, CacheStats &stats, bool countHits)
+        {
+            if (cache.owner == id)
             {
-                values[name] = std::move(value);
-                return;
+                if (countHits)
+                    stats.hits++;
+                return cache.slot;
             }
 
-            if (enclosing != nullptr)
+            stats.misses++;
+            Value *slot = get(name);
+            if (slot)
             {
-                enclosing->assign(name, std::move(value));
-                return;
+                cache.owner = id;
+                cache.slot = slot;
             }
+            return slot;
         }
 
-        Object *get(const std::string &name) const
+    private:
+        static uint32_t nextId()
         {
-            auto it = values.find(name);
-            if (it != values.end())
-                return it->second.get();
-
-            if (enclosing != nullptr)
-                return enclosing->get(name);
-
-            return nullptr;
+            static uint32_t last = 0;
+            return ++last;
         }
     };
 
 } // namespace lox
 
-#endif
\ No newline at end of file
+#endif
@@ -10,7 +10,7 @@ void ErrorHandler::report()
 {
     for (auto error : errorList)
     {
-        std::cout << "[line " + std::to_string(error.line) + "] Error" + error.where + ": " + error.message << std::endl;
+        std::cerr << "[line " + std::to_string(error.line) + "] Error" + error.where + ": " + error.message << std::endl;
     }
 }
 
@@ -1,6 +1,7 @@
 #ifndef ERROR_HANDLER_HPP
 #define ERROR_HANDLER_HPP
 
+#include <stdexcept>
 #include <string>
 #include <vector>
 
@@ -19,11 +20,20 @@ namespace lox
         ErrorHandler();
         void report();
         void add(size_t line_, const std::string &where_, const std::string &message_);
+        bool hasError() const { return foundError; }
 
     private:
         std::vector<Info> errorList;
         bool foundError;
     };
+
+    class RuntimeError : public std::runtime_error
+    {
+    public:
+        size_t line;
+
+        RuntimeError(size_t line_, const std::string &message_) : std::runtime_error(message_), line(line_) {}
+    };
 } // namespace lox
 
-#endif
\ No newline at end of file
+#endif
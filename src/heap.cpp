@@ -0,0 +1,240 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+#include "heap.hpp"
+#include "env.hpp"
+#include "chunk.hpp"
+
+using namespace lox;
+
+Heap::Heap(size_t threshold_, double growthFactor_)
+    : nextGC(threshold_), minThreshold(threshold_), growthFactor(growthFactor_) {}
+
+Heap::~Heap()
+{
+    Object *object = objects;
+    while (object)
+    {
+        Object *next = object->next;
+        delete object;
+        object = next;
+    }
+}
+
+StrObj *Heap::find(const char *chars, size_t length) const
+{
+    auto it = strings.find({chars, length});
+    return it != strings.end() ? it->second : nullptr;
+}
+
+StrObj *Heap::insert(StrObj *string)
+{
+    strings[{string->value.data(), string->value.size()}] = string;
+    string->interned = true;
+    return string;
+}
+
+StrObj *Heap::intern(const std::string &chars)
+{
+    return intern(chars.data(), chars.size());
+}
+
+StrObj *Heap::intern(std::string &&chars)
+{
+    if (StrObj *string = find(chars.data(), chars.size()))
+        return string;
+    return insert(make<StrObj>(std::move(chars)));
+}
+
+StrObj *Heap::intern(const char *chars, size_t length)
+{
+    if (StrObj *string = find(chars, length))
+        return string;
+    return insert(make<StrObj>(std::string(chars, length)));
+}
+
+StrObj *Heap::concat(StrObj *left, StrObj *right)
+{
+    if (left->length + right->length >= StrObj::ROPE_MIN)
+        return make<StrObj>(left, right);
+    return intern(left->chars() + right->chars());
+}
+
+StrObj *Heap::internPinned(const char *chars, size_t length)
+{
+    StrObj *string = intern(chars, length);
+    if (!string->pinned)
+    {
+        string->pinned = true;
+        pinnedStrings.push_back(string);
+    }
+    return string;
+}
+
+void Heap::addRoots(GCRoots *roots_)
+{
+    roots.push_back(roots_);
+}
+
+void Heap::removeRoots(GCRoots *roots_)
+{
+    roots.erase(std::remove(roots.begin(), roots.end(), roots_), roots.end());
+}
+
+void Heap::track(Object *object)
+{
+    object->next = objects;
+    objects = object;
+
+    bytesAllocated += object->size();
+    gcStats.peakBytes = std::max(gcStats.peakBytes, bytesAllocated);
+}
+
+void Heap::mark(Object *object)
+{
+    if (object == nullptr || object->marked)
+        return;
+
+    object->marked = true;
+    grayStack.push_back(object);
+}
+
+void Heap::collect()
+{
+    auto start = std::chrono::steady_clock::now();
+
+    for (StrObj *string : pinnedStrings)
+        mark(string);
+    for (GCRoots *source : roots)
+        source->markRoots(*this);
+    traceReferences();
+    removeUnmarkedStrings();
+    sweep();
+
+    nextGC = std::max(static_cast<size_t>(bytesAllocated * growthFactor), minThreshold);
+
+    double pauseMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    gcStats.collections++;
+    gcStats.totalPauseMs += pauseMs;
+    gcStats.maxPauseMs = std::max(gcStats.maxPauseMs, pauseMs);
+}
+
+void Heap::traceReferences()
+{
+    while (!grayStack.empty())
+    {
+        Object *object = grayStack.back();
+        grayStack.pop_back();
+        object->trace(*this);
+    }
+}
+
+void Heap::removeUnmarkedStrings()
+{
+    for (auto it = strings.begin(); it != strings.end();)
+    {
+        if (it->second->marked)
+            ++it;
+        else
+            it = strings.erase(it);
+    }
+}
+
+void Heap::sweep()
+{
+    // Live bytes are summed afresh rather than subtracted from, since some
+    // objects grow after they are made: a rope when it is flattened, or a
+    // pooled Env given more slots.
+    size_t live = 0;
+    Object **link = &objects;
+    while (*link)
+    {
+        Object *object = *link;
+        if (object->marked)
+        {
+            object->marked = false;
+            live += object->size();
+            link = &object->next;
+            continue;
+        }
+
+        *link = object->next;
+        size_t size = object->size();
+        gcStats.bytesFreed += size;
+        gcStats.objectsFreed++;
+        delete object;
+    }
+    bytesAllocated = live;
+}
+
+void Heap::printStats() const
+{
+    std::cerr << "[gc] collections:   " << gcStats.collections << std::endl
+              << "[gc] pause total:   " << gcStats.totalPauseMs << " ms" << std::endl
+              << "[gc] pause max:     " << gcStats.maxPauseMs << " ms" << std::endl
+              << "[gc] objects freed: " << gcStats.objectsFreed << std::endl
+              << "[gc] bytes freed:   " << gcStats.bytesFreed << std::endl
+              << "[gc] heap live:     " << bytesAllocated << " bytes" << std::endl
+              << "[gc] heap peak:     " << gcStats.peakBytes << " bytes" << std::endl;
+}
+
+/*****************************************/
+// Tracing
+
+void StrObj::trace(Heap &heap)
+{
+    heap.mark(left);
+    heap.mark(right);
+}
+
+void FuncObj::trace(Heap &heap)
+{
+    heap.mark(closure);
+}
+
+void Env::trace(Heap &heap)
+{
+    heap.mark(enclosing);
+    for (auto &slot : slots)
+        heap.mark(slot);
+}
+
+void Upvalue::trace(Heap &heap)
+{
+    heap.mark(closed);
+}
+
+void ClosureObj::trace(Heap &heap)
+{
+    for (Upvalue *upvalue : upvalues)
+        heap.mark(upvalue);
+}
+
+/*****************************************/
+// Ropes
+
+void StrObj::flatten() const
+{
+    // A string built by appending is a rope nested as deep as the number
+    // of pieces, so it is walked with a stack of its own, left to right.
+    std::string chars;
+    chars.reserve(length);
+    std::vector<const StrObj *> pending(1, this);
+    while (!pending.empty())
+    {
+        const StrObj *piece = pending.back();
+        pending.pop_back();
+        if (piece->left)
+        {
+            pending.push_back(piece->right);
+            pending.push_back(piece->left);
+        }
+        else
+            chars += piece->value;
+    }
+
+    value = std::move(chars);
+    left = nullptr;
+    right = nullptr;
+}
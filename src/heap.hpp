@@ -0,0 +1,154 @@
+#ifndef HEAP_HPP
+#define HEAP_HPP
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "object.hpp"
+
+namespace lox
+{
+
+    class Heap;
+
+    /// Anything holding Values or objects the collector cannot see by
+    /// tracing from other objects: interpreter registers, env stacks, the VM
+    /// stack, globals. Sources register themselves with the Heap.
+    class GCRoots
+    {
+    public:
+        virtual ~GCRoots() {}
+
+        virtual void markRoots(Heap &heap) = 0;
+    };
+
+    /// Owns every Lox heap object and reclaims unreachable ones with a
+    /// stop-the-world mark-sweep pass. A collection is triggered when the
+    /// bytes allocated since the last one exceed the current threshold; the
+    /// threshold then grows to `growthFactor` times the surviving heap.
+    class Heap
+    {
+    public:
+        struct Stats
+        {
+            size_t collections = 0;
+            size_t objectsFreed = 0;
+            size_t bytesFreed = 0;
+            size_t peakBytes = 0;
+            double totalPauseMs = 0;
+            double maxPauseMs = 0;
+        };
+
+        static const size_t DEFAULT_THRESHOLD = 1024 * 1024;
+
+        Heap(size_t threshold_ = DEFAULT_THRESHOLD, double growthFactor_ = 2.0);
+
+        ~Heap();
+
+        Heap(const Heap &) = delete;
+        Heap &operator=(const Heap &) = delete;
+
+        template <typename T, typename... Args>
+        T *make(Args &&... args)
+        {
+            if (bytesAllocated + sizeof(T) > nextGC)
+                collect();
+
+            T *object = new T(std::forward<Args>(args)...);
+            track(object);
+            return object;
+        }
+
+        /// Returns the one StrObj holding `chars`, creating it if needed, so
+        /// equal strings are always the same object.
+        StrObj *intern(const std::string &chars);
+        StrObj *intern(std::string &&chars);
+        StrObj *intern(const char *chars, size_t length);
+
+        /// `left` followed by `right`: a rope when long enough, otherwise
+        /// interned. Both must be reachable, as a collection may run.
+        StrObj *concat(StrObj *left, StrObj *right);
+
+        /// Like intern(), but the string is never collected. Used for names
+        /// and literals taken from source, which the AST refers to directly.
+        /// Looking up an existing string does not allocate.
+        StrObj *internPinned(const char *chars, size_t length);
+
+        void addRoots(GCRoots *roots_);
+        void removeRoots(GCRoots *roots_);
+
+        void mark(Object *object);
+        void mark(const Value &value)
+        {
+            if (value.isObj())
+                mark(value.as.object);
+        }
+
+        void collect();
+
+        size_t bytes() const { return bytesAllocated; }
+        const Stats &stats() const { return gcStats; }
+        void printStats() const;
+
+    private:
+        /// A run of characters the table can be probed with without first
+        /// copying it into a std::string.
+        struct StrKey
+        {
+            const char *chars;
+            size_t length;
+        };
+
+        struct StrKeyHash
+        {
+            size_t operator()(const StrKey &key) const
+            {
+                // FNV-1a
+                size_t hash = 2166136261u;
+                for (size_t i = 0; i < key.length; i++)
+                {
+                    hash ^= static_cast<unsigned char>(key.chars[i]);
+                    hash *= 16777619u;
+                }
+                return hash;
+            }
+        };
+
+        struct StrKeyEqual
+        {
+            bool operator()(const StrKey &a, const StrKey &b) const
+            {
+                return a.length == b.length && std::memcmp(a.chars, b.chars, a.length) == 0;
+            }
+        };
+
+        /// Weak: entries whose string was not marked are dropped before the
+        /// sweep frees them. Keys point at the StrObj's own characters.
+        std::unordered_map<StrKey, StrObj *, StrKeyHash, StrKeyEqual> strings;
+
+        StrObj *find(const char *chars, size_t length) const;
+        StrObj *insert(StrObj *string);
+        std::vector<StrObj *> pinnedStrings;
+
+        Object *objects = nullptr;
+        std::vector<Object *> grayStack;
+        std::vector<GCRoots *> roots;
+
+        size_t bytesAllocated = 0;
+        size_t nextGC;
+        size_t minThreshold;
+        double growthFactor;
+        Stats gcStats;
+
+        void track(Object *object);
+        void traceReferences();
+        void removeUnmarkedStrings();
+        void sweep();
+    };
+} // namespace lox
+
+#endif
@@ -0,0 +1,105 @@
+#include <algorithm>
+#include <iomanip>
+#include <string>
+#include <utility>
+
+#include "hotspots.hpp"
+
+using namespace lox;
+
+static const char *const kindNames[Hotspots::KINDS] = {
+    "AssignExpr",
+    "BinaryExpr",
+    "CallExpr",
+    "GroupingExpr",
+    "NilLiteralExpr",
+    "BoolLiteralExpr",
+    "NumLiteralExpr",
+    "StrLiteralExpr",
+    "LogicExpr",
+    "UnaryExpr",
+    "VarExpr",
+    "AddAssignExpr",
+    "CompareConstExpr",
+    "BlockStmt",
+    "ClassStmt",
+    "ExprStmt",
+    "FuncStmt",
+    "IfStmt",
+    "PrintStmt",
+    "ReturnStmt",
+    "VarStmt",
+    "WhileStmt",
+};
+
+void Hotspots::enter(size_t kind, uint32_t line)
+{
+    Counter *kindCounter = &kinds[kind];
+    Counter *lineCounter = &lines[line];
+    kindCounter->active++;
+    lineCounter->active++;
+    frames.push_back({kindCounter, lineCounter, Clock::now(), 0});
+}
+
+void Hotspots::exit()
+{
+    Frame frame = frames.back();
+    frames.pop_back();
+
+    uint64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - frame.start).count();
+    uint64_t self = elapsed > frame.childNs ? elapsed - frame.childNs : 0;
+    if (!frames.empty())
+        frames.back().childNs += elapsed;
+
+    for (Counter *counter : {frame.kind, frame.line})
+    {
+        counter->count++;
+        counter->selfNs += self;
+        if (--counter->active == 0)
+            counter->totalNs += elapsed;
+    }
+}
+
+void Hotspots::print(std::ostream &out, size_t topLines) const
+{
+    struct Row
+    {
+        std::string label;
+        const Counter *counter;
+    };
+
+    auto printRows = [&out](const std::string &heading, std::vector<Row> rows, size_t limit) {
+        std::sort(rows.begin(), rows.end(), [](const Row &a, const Row &b) {
+            return a.counter->selfNs > b.counter->selfNs;
+        });
+        if (rows.size() > limit)
+            rows.resize(limit);
+
+        out << "[hotspots] " << std::left << std::setw(18) << heading << std::right
+            << std::setw(14) << "count"
+            << std::setw(12) << "self ms"
+            << std::setw(12) << "total ms" << std::endl;
+        out << std::fixed << std::setprecision(2);
+        for (auto &row : rows)
+        {
+            out << "[hotspots] " << std::left << std::setw(18) << row.label << std::right
+                << std::setw(14) << row.counter->count
+                << std::setw(12) << row.counter->selfNs / 1e6
+                << std::setw(12) << row.counter->totalNs / 1e6 << std::endl;
+        }
+        out.unsetf(std::ios::floatfield);
+    };
+
+    std::vector<Row> rows;
+    for (size_t kind = 0; kind < KINDS; kind++)
+    {
+        if (kinds[kind].count > 0)
+            rows.push_back({kindNames[kind], &kinds[kind]});
+    }
+    printRows("node kind", rows, rows.size());
+
+    rows.clear();
+    for (auto &line : lines)
+        rows.push_back({"line " + std::to_string(line.first), &line.second});
+    printRows("source line", rows, topLines);
+}
@@ -0,0 +1,74 @@
+#ifndef HOTSPOTS_HPP
+#define HOTSPOTS_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+#include "ast.hpp"
+
+namespace lox
+{
+
+    /// Execution counts and timings for the tree-walking interpreter,
+    /// collected per node kind and per source line under --hotspots.
+    ///
+    /// Self time excludes the node's children. Total time includes them but
+    /// counts nested runs of the same kind (or line) only once, so a
+    /// recursive CallExpr is not charged for itself repeatedly.
+    class Hotspots
+    {
+    public:
+        static const size_t EXPR_KINDS = static_cast<size_t>(ExprType::CompareConstExprType) + 1;
+        static const size_t KINDS = EXPR_KINDS + static_cast<size_t>(StmtType::WhileStmtType) + 1;
+
+        static size_t kindOf(const Expr *expr) { return static_cast<size_t>(expr->type); }
+        static size_t kindOf(const Stmt *stmt) { return EXPR_KINDS + static_cast<size_t>(stmt->type); }
+
+        /// Times one node execution for as long as it is in scope.
+        class Scope
+        {
+            Hotspots &hotspots;
+
+        public:
+            Scope(Hotspots &hotspots_, size_t kind, uint32_t line) : hotspots(hotspots_) { hotspots.enter(kind, line); }
+            ~Scope() { hotspots.exit(); }
+        };
+
+        Hotspots() : kinds(KINDS) {}
+
+        void enter(size_t kind, uint32_t line);
+        void exit();
+
+        /// Writes the per-kind table and the `topLines` hottest lines,
+        /// both sorted by self time.
+        void print(std::ostream &out, size_t topLines = 20) const;
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        struct Counter
+        {
+            uint64_t count = 0;
+            uint64_t selfNs = 0;
+            uint64_t totalNs = 0;
+            int active = 0;
+        };
+
+        struct Frame
+        {
+            Counter *kind;
+            Counter *line;
+            Clock::time_point start;
+            uint64_t childNs;
+        };
+
+        std::vector<Counter> kinds;
+        std::unordered_map<uint32_t, Counter> lines;
+        std::vector<Frame> frames;
+    };
+} // namespace lox
+
+#endif
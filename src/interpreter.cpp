@@ -1,293 +1,523 @@
+#include <algorithm>
 #include <iostream>
 
 #include "interpreter.hpp"
+#include "natives.hpp"
 
 using namespace lox;
 
+// The same checks and messages as the VM, so both engines fail alike.
+static void checkNumber(const Token *op, const Value &operand)
+{
+    if (!operand.isNum())
+        throw RuntimeError(op->line, "Operand must be a number.");
+}
+
+static void checkNumbers(const Token *op, const Value &left, const Value &right)
+{
+    if (!left.isNum() || !right.isNum())
+        throw RuntimeError(op->line, "Operands must be numbers.");
+}
+
+Interpreter::Interpreter(Heap &heap_) : heap(heap_), env(nullptr), value(), completion(Completion::Normal)
+{
+    heap.addRoots(this);
+    defineNatives(heap, [this](StrObj *name, Value native) { globals.define(name, native); });
+}
+
+Interpreter::~Interpreter()
+{
+    heap.removeRoots(this);
+}
+
+void Interpreter::markRoots(Heap &heap_)
+{
+    heap_.mark(value);
+    heap_.mark(env);
+    for (Env *outer : envStack)
+        heap_.mark(outer);
+    for (Env *pooled : envPool)
+        heap_.mark(pooled);
+    for (auto &temp : temps)
+        heap_.mark(temp);
+    for (auto &global : globals.values)
+        heap_.mark(global.second);
+}
+
 void Interpreter::interpret(StmtList &statements)
 {
-    for (auto &stmt : statements)
-        execute(stmt.get());
+    // Every Lox call nests C++ calls, so the program runs on a stack sized
+    // for maxDepth of them rather than on the caller's, where there is one.
+    size_t callBytes = maxDepth * FRAME_BYTES;
+    bool started = nativeStack.run(callBytes + STACK_RESERVE, [&] {
+        size_t usable = std::min(callBytes, nativeStack.size() - STACK_RESERVE);
+        stackLimit = static_cast<const char *>(__builtin_frame_address(0)) - usable;
+        try
+        {
+            for (auto &stmt : statements)
+                execute(stmt);
+        }
+        catch (RuntimeError &)
+        {
+            env = nullptr;
+            envStack.clear();
+            temps.clear();
+            callStack.clear();
+            depth = 0;
+            value = Value();
+            completion = Completion::Normal;
+            throw;
+        }
+    });
+
+    if (!started)
+        throw RuntimeError(0, "Could not reserve a stack for " + std::to_string(maxDepth) + " calls.");
 }
 
 void Interpreter::execute(Stmt *stmt)
 {
+    if (__builtin_expect(hotspots != nullptr, 0))
+        executeTimed(stmt);
+    else
+        stmt->accept(*this);
+}
+
+void Interpreter::executeTimed(Stmt *stmt)
+{
+    Hotspots::Scope scope(*hotspots, Hotspots::kindOf(stmt), stmt->line);
     stmt->accept(*this);
 }
 
+void Interpreter::executeTailCallTimed(StmtList &body, Env *new_env)
+{
+    // A tail call never runs visit(CallExpr), so its callee is timed here,
+    // nested in the CallExpr that started the chain.
+    Hotspots::Scope scope(*hotspots, Hotspots::kindOf(tailCall), tailCall->line);
+    executeBlock(body, new_env);
+}
+
 void Interpreter::visit(BlockStmt *stmt)
 {
-    EnvPtr new_env = std::make_shared<Env>(env);
-    executeBlock(stmt->statements, new_env);
+    if (stmt->slotCount == 0)
+    {
+        for (auto &statement : stmt->statements)
+        {
+            execute(statement);
+            if (completion != Completion::Normal)
+                break;
+        }
+        return;
+    }
+
+    if (stmt->captured)
+    {
+        executeBlock(stmt->statements, heap.make<Env>(env, stmt->slotCount));
+        return;
+    }
+
+    Env *scope = acquireEnv(env, stmt->slotCount);
+    executeBlock(stmt->statements, scope);
+    releaseEnv(scope);
 }
 
-void Interpreter::executeBlock(StmtList &statements_, EnvPtr env_)
+Env *Interpreter::acquireEnv(Env *enclosing, size_t slotCount)
 {
-    EnvPtr previous = env;
+    if (envPool.empty())
+        return heap.make<Env>(enclosing, slotCount);
+
+    Env *scope = envPool.back();
+    envPool.pop_back();
+    scope->enclosing = enclosing;
+    scope->slots.resize(slotCount);
+    return scope;
+}
+
+void Interpreter::releaseEnv(Env *scope)
+{
+    scope->enclosing = nullptr;
+    scope->slots.clear();
+    envPool.push_back(scope);
+}
+
+void Interpreter::executeBlock(StmtList &statements_, Env *env_)
+{
+    envStack.push_back(env);
 
     env = env_;
     for (auto &stmt : statements_)
     {
-        execute(stmt.get());
+        execute(stmt);
+        if (completion != Completion::Normal)
+            break;
     }
-    env = previous;
+    env = envStack.back();
+    envStack.pop_back();
 }
 
 void Interpreter::visit(FuncStmt *stmt)
 {
-    std::unique_ptr<Object> function = std::unique_ptr<FuncObj>(new FuncObj(stmt, env));
-    env->define(stmt->name->lexeme, std::move(function));
+    define(stmt->slot, stmt->name, Value(heap.make<FuncObj>(stmt, env)));
+}
+
+void Interpreter::define(int slot, const Token *name, Value value_)
+{
+    if (slot < 0)
+        globals.define(name->literal.string, value_);
+    else
+        env->slots[slot] = std::move(value_);
 }
 
 void Interpreter::visit(ExprStmt *stmt)
 {
-    value = evaluate(stmt->expression.get());
+    value = evaluate(stmt->expression);
 }
 
 void Interpreter::visit(IfStmt *stmt)
 {
-    value = evaluate(stmt->condition.get());
-    if (value->isTrue())
-        execute(stmt->thenBranch.get());
+    if (evaluate(stmt->condition).isTrue())
+        execute(stmt->thenBranch);
     else if (stmt->elseBranch)
-        execute(stmt->elseBranch.get());
-    value = nullptr;
+        execute(stmt->elseBranch);
 }
 
 void Interpreter::visit(PrintStmt *stmt)
 {
-    value = evaluate(stmt->expression.get());
-    if (value)
-    {
-        std::cout << value->toString() << std::endl;
-    }
-    value = nullptr;
+    value = evaluate(stmt->expression);
+    std::cout << value.toString() << std::endl;
+    value = Value();
 }
 
 void Interpreter::visit(VarStmt *stmt)
 {
     if (stmt->initializer)
-        value = evaluate(stmt->initializer.get());
-    env->define(stmt->name->lexeme, value->clone());
-    value = nullptr;
+        value = evaluate(stmt->initializer);
+    define(stmt->slot, stmt->name, std::move(value));
+    value = Value();
 }
 
 void Interpreter::visit(WhileStmt *stmt)
 {
-    value = evaluate(stmt->condition.get());
-    while (value->isTrue())
+    value = evaluate(stmt->condition);
+    while (value.isTrue())
     {
-        execute(stmt->body.get());
-        value = evaluate(stmt->condition.get());
+        execute(stmt->body);
+        if (completion != Completion::Normal)
+            return;
+        if (stmt->increment)
+            evaluate(stmt->increment);
+        if (Profiler::pending)
+            sample();
+        value = evaluate(stmt->condition);
     }
-    value = nullptr;
+    value = Value();
 }
 
 void Interpreter::visit(ReturnStmt *stmt)
 {
+    if (stmt->value != nullptr && stmt->value->type == ExprType::CallExprType)
+    {
+        // A call in tail position is left for the enclosing call() to run
+        // in place of the current frame, so tail recursion keeps the C++
+        // stack flat. Natives never recurse and are called right away.
+        auto *tail = static_cast<CallExpr *>(stmt->value);
+        size_t base = pushCall(tail);
+        if (temps[base].isNative())
+        {
+            callNative(temps[base].asNative(), tail->arguments.size(), temps.data() + base + 1, tail->line);
+            temps.resize(base);
+            completion = Completion::Return;
+            return;
+        }
+
+        calleeAt(base, tail->arguments.size(), tail->line);
+        tailCallBase = base;
+        tailCall = tail;
+        completion = Completion::TailCall;
+        return;
+    }
+
     if (stmt->value != nullptr)
-        value = evaluate(stmt->value.get());
+        value = evaluate(stmt->value);
     else
-        value = std::unique_ptr<Object>(new NilObj());
-    throw BoolObj(true);
+        value = Value();
+    completion = Completion::Return;
 }
 
-ObjPtr Interpreter::evaluate(Expr *expr)
+Value Interpreter::evaluate(Expr *expr)
 {
-    expr->accept(*this);
+    if (__builtin_expect(hotspots != nullptr, 0))
+        evaluateTimed(expr);
+    else
+        expr->accept(*this);
     return std::move(value);
 }
 
+void Interpreter::evaluateTimed(Expr *expr)
+{
+    Hotspots::Scope scope(*hotspots, Hotspots::kindOf(expr), expr->line);
+    expr->accept(*this);
+}
+
 void Interpreter::visit(AssignExpr *expr)
 {
-    value = evaluate(expr->value.get());
-    env->assign(expr->name->lexeme, value->clone());
+    value = evaluate(expr->value);
+    if (expr->depth >= 0)
+        env->at(expr->depth, expr->slot) = value;
+    else if (Value *global = globals.get(expr->name->literal.string, expr->cache, globalWrites, countCacheHits))
+        *global = value;
+    else
+        throw RuntimeError(expr->name->line, "Undefined variable '" + expr->name->lexeme() + "'.");
 }
 
 void Interpreter::visit(BinaryExpr *expr)
 {
-    ObjPtr left = ObjPtr(evaluate(expr->left.get()));
-    ObjPtr right = ObjPtr(evaluate(expr->right.get()));
+    Value left = evaluate(expr->left);
+    TempRoot leftRoot(temps, left);
+    Value right = evaluate(expr->right);
 
     switch (expr->op->type)
     {
     case TokenType::GREATER:
-    {
-        double leftValue = static_cast<NumObj *>(left.get())->value;
-        double rightValue = static_cast<NumObj *>(right.get())->value;
-        value.reset(new BoolObj(leftValue > rightValue));
+        checkNumbers(expr->op, left, right);
+        value = Value(left.asNum() > right.asNum());
         break;
-    }
     case TokenType::GREATER_EQUAL:
-    {
-        double leftValue = static_cast<NumObj *>(left.get())->value;
-        double rightValue = static_cast<NumObj *>(right.get())->value;
-        value.reset(new BoolObj(leftValue >= rightValue));
+        checkNumbers(expr->op, left, right);
+        value = Value(left.asNum() >= right.asNum());
         break;
-    }
     case TokenType::LESS:
-    {
-        double leftValue = static_cast<NumObj *>(left.get())->value;
-        double rightValue = static_cast<NumObj *>(right.get())->value;
-        value.reset(new BoolObj(leftValue < rightValue));
+        checkNumbers(expr->op, left, right);
+        value = Value(left.asNum() < right.asNum());
         break;
-    }
     case TokenType::LESS_EQUAL:
-    {
-        double leftValue = static_cast<NumObj *>(left.get())->value;
-        double rightValue = static_cast<NumObj *>(right.get())->value;
-        value.reset(new BoolObj(leftValue <= rightValue));
+        checkNumbers(expr->op, left, right);
+        value = Value(left.asNum() <= right.asNum());
         break;
-    }
     case TokenType::BANG_EQUAL:
-    {
-        value.reset(new BoolObj(!left->equals(right.get())));
+        value = Value(!left.equals(right));
         break;
-    }
     case TokenType::EQUAL_EQUAL:
-    {
-        value.reset(new BoolObj(left->equals(right.get())));
+        value = Value(left.equals(right));
         break;
-    }
     case TokenType::MINUS:
-    {
-        double leftValue = static_cast<NumObj *>(left.get())->value;
-        double rightValue = static_cast<NumObj *>(right.get())->value;
-        value.reset(new NumObj(leftValue - rightValue));
+        checkNumbers(expr->op, left, right);
+        value = Value(left.asNum() - right.asNum());
         break;
-    }
     case TokenType::PLUS:
     {
-        if (left->type == ObjectType::NumType && right->type == ObjectType::NumType)
+        if (left.isNum() && right.isNum())
+            value = Value(left.asNum() + right.asNum());
+        else if (left.isStr() && right.isStr())
         {
-            double leftValue = static_cast<NumObj *>(left.get())->value;
-            double rightValue = static_cast<NumObj *>(right.get())->value;
-            value.reset(new NumObj(leftValue + rightValue));
+            TempRoot rightRoot(temps, right);
+            value = Value(heap.concat(left.asStr(), right.asStr()));
         }
-
-        if (left->type == ObjectType::StrType && right->type == ObjectType::StrType)
-        {
-            const std::string &leftValue = static_cast<StrObj *>(left.get())->value;
-            const std::string &rightValue =
-                static_cast<StrObj *>(right.get())->value;
-            value.reset(new StrObj(leftValue + rightValue));
-        }
-
+        else
+            throw RuntimeError(expr->op->line, "Operands must be two numbers or two strings.");
         break;
     }
     case TokenType::SLASH:
-    {
-        double leftValue = static_cast<NumObj *>(left.get())->value;
-        double rightValue = static_cast<NumObj *>(right.get())->value;
-        value.reset(new NumObj(leftValue / rightValue));
+        checkNumbers(expr->op, left, right);
+        value = Value(left.asNum() / right.asNum());
         break;
-    }
     case TokenType::STAR:
-    {
-        double leftValue = static_cast<NumObj *>(left.get())->value;
-        double rightValue = static_cast<NumObj *>(right.get())->value;
-        value.reset(new NumObj(leftValue * rightValue));
+        checkNumbers(expr->op, left, right);
+        value = Value(left.asNum() * right.asNum());
         break;
-    }
     default:
         break;
     }
 }
 
+size_t Interpreter::pushCall(CallExpr *expr)
+{
+    // The callee and arguments stay on the temp stack until the call has
+    // copied them into its frame.
+    size_t base = temps.size();
+    temps.push_back(evaluate(expr->callee));
+    for (auto &arg : expr->arguments)
+        temps.push_back(evaluate(arg));
+    return base;
+}
+
 void Interpreter::visit(CallExpr *expr)
 {
-    ObjPtr callee = evaluate(expr->callee.get());
-    ObjList arguments;
-    for (auto arg : expr->arguments)
-        arguments.push_back(evaluate(arg.get()));
+    size_t base = pushCall(expr);
+    if (temps[base].isNative())
+    {
+        callNative(temps[base].asNative(), expr->arguments.size(), temps.data() + base + 1, expr->line);
+        temps.resize(base);
+        return;
+    }
+
+    FuncObj *callFunc = calleeAt(base, expr->arguments.size(), expr->line);
+    if (depth == maxDepth || static_cast<const char *>(__builtin_frame_address(0)) < stackLimit)
+        throw RuntimeError(expr->line, "Stack overflow.");
+
+    this->call(callFunc, temps.data() + base + 1);
+    temps.resize(base);
+}
+
+FuncObj *Interpreter::calleeAt(size_t base, size_t argCount, size_t line)
+{
+    if (!temps[base].isFunc())
+        throw RuntimeError(line, "Can only call functions.");
 
-    FuncObj *callFunc = static_cast<FuncObj *>(callee.get());
-    // if(arguments.size() != callFunc->arity())
-    // error
+    FuncObj *callFunc = temps[base].asFunc();
+    if (argCount != callFunc->arity())
+        throw RuntimeError(line, "Expected " + std::to_string(callFunc->arity()) +
+                                     " arguments but got " + std::to_string(argCount) + ".");
 
-    this->call(callFunc, std::move(arguments));
+    if (__builtin_expect(callFunc->declaration->lazyAst != nullptr, 0))
+        lazyBodies->materialize(callFunc->declaration, line);
+    return callFunc;
 }
 
-void Interpreter::call(FuncObj *callfunc, ObjList &&arguments)
+void Interpreter::callNative(NativeObj *native, size_t argCount, const Value *arguments, size_t line)
 {
-    EnvPtr new_env = std::make_shared<Env>(callfunc->closure);
-    EnvPtr previous = env;
+    if (argCount != native->arity)
+        throw RuntimeError(line, "Expected " + std::to_string(native->arity) +
+                                     " arguments but got " + std::to_string(argCount) + ".");
 
-    for (size_t i = 0; i < callfunc->declaration->params.size(); i++)
+    try
     {
-        new_env->define(callfunc->declaration->params[i].get()->lexeme, std::move(arguments[i]));
+        value = native->function(heap, arguments);
     }
-    try
+    catch (NativeError &error)
     {
-        executeBlock(callfunc->declaration->body, new_env);
+        throw RuntimeError(line, error.what());
     }
-    catch (BoolObj &)
+}
+
+void Interpreter::call(FuncObj *callfunc, const Value *arguments)
+{
+    FuncStmt *declaration = callfunc->declaration;
+    Env *new_env = enterFrame(callfunc, arguments);
+
+    if (profiler)
     {
-        env = previous;
-        return;
+        callStack.push_back(declaration);
+        if (Profiler::pending)
+            sample();
+    }
+
+    depth++;
+    executeBlock(declaration->body, new_env);
+
+    // Each tail call replaces the frame that made it, however long the
+    // chain of them.
+    while (completion == Completion::TailCall)
+    {
+        if (!declaration->captured)
+            releaseEnv(new_env);
+
+        callfunc = temps[tailCallBase].asFunc();
+        declaration = callfunc->declaration;
+        new_env = enterFrame(callfunc, temps.data() + tailCallBase + 1);
+        temps.resize(tailCallBase);
+        completion = Completion::Normal;
+
+        if (profiler)
+            callStack.back() = declaration;
+
+        if (__builtin_expect(hotspots != nullptr, 0))
+            executeTailCallTimed(declaration->body, new_env);
+        else
+            executeBlock(declaration->body, new_env);
     }
+
+    if (completion == Completion::Return)
+        completion = Completion::Normal;
+    else
+        value = Value();
+
+    if (!declaration->captured)
+        releaseEnv(new_env);
+
+    depth--;
+    if (profiler)
+        callStack.pop_back();
+}
+
+Env *Interpreter::enterFrame(FuncObj *callfunc, const Value *arguments)
+{
+    FuncStmt *declaration = callfunc->declaration;
+    Env *new_env = declaration->captured ? heap.make<Env>(callfunc->closure, declaration->slotCount)
+                                         : acquireEnv(callfunc->closure, declaration->slotCount);
+
+    for (size_t i = 0; i < declaration->params.size(); i++)
+    {
+        new_env->slots[i] = arguments[i];
+    }
+    return new_env;
+}
+
+void Interpreter::sample()
+{
+    if (!profiler)
+        return;
+
+    std::string stack = "script";
+    for (const FuncStmt *function : callStack)
+        Profiler::appendFrame(stack, function->name->lexeme(), function->name->line);
+    profiler->record(stack);
 }
 
 void Interpreter::visit(GroupingExpr *expr)
 {
-    value = evaluate(expr->expression.get());
+    value = evaluate(expr->expression);
 }
 
 void Interpreter::visit(BoolLiteralExpr *expr)
 {
-    value.reset(new BoolObj(expr->literal));
+    value = Value(expr->literal);
 }
 
-void Interpreter::visit(NilLiteralExpr *expr)
+void Interpreter::visit(NilLiteralExpr *)
 {
-    value.reset(new NilObj());
+    value = Value();
 }
 
 void Interpreter::visit(NumLiteralExpr *expr)
 {
-    value.reset(new NumObj(expr->literal));
+    value = Value(expr->literal);
 }
 
 void Interpreter::visit(StrLiteralExpr *expr)
 {
-    value.reset(new StrObj(expr->literal));
+    value = Value(expr->literal);
 }
 
 void Interpreter::visit(LogicExpr *expr)
 {
-    ObjPtr left = ObjPtr(evaluate(expr->left.get()));
+    Value left = evaluate(expr->left);
 
-    value.reset(new BoolObj(left->isTrue()));
+    value = Value(left.isTrue());
 
-    if (expr->opr->type == TokenType::OR && !left->isTrue())
+    if (expr->opr->type == TokenType::OR && !left.isTrue())
     {
-        value = evaluate(expr->right.get());
+        value = evaluate(expr->right);
     }
 
-    if (expr->opr->type == TokenType::AND && left->isTrue())
+    if (expr->opr->type == TokenType::AND && left.isTrue())
     {
-        value = evaluate(expr->right.get());
+        value = evaluate(expr->right);
     }
 }
 
 void Interpreter::visit(UnaryExpr *expr)
 {
-    ObjPtr right = ObjPtr(evaluate(expr->right.get()));
+    Value right = evaluate(expr->right);
 
     switch (expr->op->type)
     {
     case TokenType::BANG:
-    {
-        BoolObj *result = static_cast<BoolObj *>(right.get());
-        value.reset(new BoolObj(!result->isTrue()));
+        value = Value(!right.isTrue());
         break;
-    }
     case TokenType::MINUS:
-    {
-        NumObj *result = static_cast<NumObj *>(right.get());
-        value.reset(new NumObj(-result->value));
+        checkNumber(expr->op, right);
+        value = Value(-right.asNum());
         break;
-    }
     default:
         break;
     }
@@ -295,5 +525,79 @@ void Interpreter::visit(UnaryExpr *expr)
 
 void Interpreter::visit(VarExpr *expr)
 {
-    value = env->get(expr->name->lexeme)->clone();
+    if (expr->depth >= 0)
+    {
+        value = env->at(expr->depth, expr->slot);
+        return;
+    }
+
+    Value *global = globals.get(expr->name->literal.string, expr->cache, globalReads, countCacheHits);
+    if (!global)
+        throw RuntimeError(expr->name->line, "Undefined variable '" + expr->name->lexeme() + "'.");
+    value = *global;
+}
+
+void Interpreter::visit(AddAssignExpr *expr)
+{
+    Value *target;
+    if (expr->depth >= 0)
+        target = &env->at(expr->depth, expr->slot);
+    else
+    {
+        // One lookup serves both the read and the write, and is counted as
+        // both, so --ic-stats reads the same with the optimizer on or off.
+        size_t misses = globalReads.misses;
+        if (!(target = globals.get(expr->name->literal.string, expr->cache, globalReads, countCacheHits)))
+            throw RuntimeError(expr->name->line, "Undefined variable '" + expr->name->lexeme() + "'.");
+        if (globalReads.misses != misses)
+            globalWrites.misses++;
+        else if (countCacheHits)
+            globalWrites.hits++;
+    }
+
+    // The operand may reassign the variable, so it is read first, as the
+    // unfused `name = name + operand` would.
+    Value left = *target;
+    TempRoot leftRoot(temps, left);
+    Value right = evaluate(expr->operand);
+
+    if (left.isNum() && right.isNum())
+        value = Value(left.asNum() + right.asNum());
+    else if (left.isStr() && right.isStr())
+    {
+        TempRoot rightRoot(temps, right);
+        value = Value(heap.concat(left.asStr(), right.asStr()));
+    }
+    else
+        throw RuntimeError(expr->name->line, "Operands must be two numbers or two strings.");
+    *target = value;
+}
+
+void Interpreter::visit(CompareConstExpr *expr)
+{
+    Value left;
+    if (expr->depth >= 0)
+        left = env->at(expr->depth, expr->slot);
+    else if (Value *global = globals.get(expr->name->literal.string, expr->cache, globalReads, countCacheHits))
+        left = *global;
+    else
+        throw RuntimeError(expr->name->line, "Undefined variable '" + expr->name->lexeme() + "'.");
+    if (!left.isNum())
+        throw RuntimeError(expr->op->line, "Operands must be numbers.");
+
+    switch (expr->op->type)
+    {
+    case TokenType::GREATER:
+        value = Value(left.asNum() > expr->constant);
+        break;
+    case TokenType::GREATER_EQUAL:
+        value = Value(left.asNum() >= expr->constant);
+        break;
+    case TokenType::LESS:
+        value = Value(left.asNum() < expr->constant);
+        break;
+    default:
+        value = Value(left.asNum() <= expr->constant);
+        break;
+    }
 }
@@ -4,31 +4,160 @@
 #include "ast.hpp"
 #include "object.hpp"
 #include "env.hpp"
+#include "heap.hpp"
+#include "hotspots.hpp"
+#include "lazy.hpp"
 #include "parser.hpp"
+#include "profiler.hpp"
+#include "stack.hpp"
 
 namespace lox
 {
 
-    using ObjPtr = std::unique_ptr<Object>;
-    using ObjList = std::vector<ObjPtr>;
-    using EnvPtr = std::shared_ptr<Env>;
+    using ObjList = std::vector<Value>;
 
-    class Interpreter : public ExprVisitor, StmtVisitor
+    /// How the most recently executed statement finished. Anything other
+    /// than Normal unwinds enclosing blocks and loops until a handler (the
+    /// function call, for Return and TailCall) resets it.
+    enum class Completion
+    {
+        Normal,
+        Return,
+
+        /// `return f(...)`: the callee and arguments are on the temp stack
+        /// for the current call to run in place of its own frame.
+        TailCall,
+    };
+
+    class Interpreter : public ExprVisitor, StmtVisitor, GCRoots
     {
     public:
-        EnvPtr env;
-        ObjPtr value;
+        Heap &heap;
+        GlobalEnv globals;
+        Env *env;
+        Value value;
+        Completion completion;
+
+        /// Set while running under --profile.
+        Profiler *profiler = nullptr;
+
+        /// Set while running under --hotspots.
+        Hotspots *hotspots = nullptr;
+
+        /// Set under --lazy-parse, to finish function bodies on first call.
+        LazyBodies *lazyBodies = nullptr;
+
+        /// Function calls that may be active at once before a call fails
+        /// with a stack overflow; set by --max-depth.
+        size_t maxDepth = DEFAULT_MAX_DEPTH;
+
+        /// Native stack set aside for each Lox call, which nests several
+        /// visits, and for everything else on the interpreter's thread.
+        static const size_t FRAME_BYTES = 2048;
+        static const size_t STACK_RESERVE = 1 << 20;
 
-        Interpreter() : value(nullptr), env(new Env()) {}
+        /// Inline caches on global VarExprs and AssignExprs. Misses are
+        /// always counted, hits only when asked for.
+        CacheStats globalReads;
+        CacheStats globalWrites;
+        bool countCacheHits = false;
+
+        Interpreter(Heap &heap_);
+
+        ~Interpreter();
+
+        Interpreter(const Interpreter &) = delete;
+        Interpreter &operator=(const Interpreter &) = delete;
 
         void interpret(StmtList &statements);
 
+        /// Starts over with only the natives defined, for running a program
+        /// again from scratch.
+        void resetGlobals() { globals.reset(); }
+
+        void defineGlobal(StrObj *name, Value value_) { globals.define(name, value_); }
+
+        void markRoots(Heap &heap_) override;
+
     private:
+        /// Environments of the blocks and calls currently being executed,
+        /// outermost first. The innermost one is `env`.
+        std::vector<Env *> envStack;
+
+        /// Emptied Envs of blocks and call frames no closure could capture,
+        /// reused by the next such scope instead of allocating. Kept alive
+        /// as roots.
+        std::vector<Env *> envPool;
+
+        /// Values computed but not yet consumed, e.g. the left operand of a
+        /// binary expression or the arguments of a pending call. The
+        /// collector treats them as roots.
+        ObjList temps;
+
+        /// Where the callee of a pending tail call sits on the temp stack,
+        /// followed by its arguments.
+        size_t tailCallBase = 0;
+
+        /// The call expression of that tail call, which --hotspots charges
+        /// with the callee's run.
+        CallExpr *tailCall = nullptr;
+
+        /// What the program runs on; see interpret().
+        NativeStack nativeStack;
+
+        /// Calls currently active, not counting tail calls, which reuse
+        /// their caller's frame.
+        size_t depth = 0;
+
+        /// How far down the native stack may grow before a call is refused.
+        /// Deeply nested expressions can use it up before maxDepth is hit.
+        const char *stackLimit = nullptr;
+
+        /// Functions currently being called, outermost first. Only kept
+        /// while profiling.
+        std::vector<const FuncStmt *> callStack;
+
+        /// Roots a temporary for the lifetime of the guard.
+        class TempRoot
+        {
+            ObjList &temps;
+
+        public:
+            TempRoot(ObjList &temps_, const Value &value_) : temps(temps_) { temps.push_back(value_); }
+            ~TempRoot() { temps.pop_back(); }
+        };
+
         void execute(Stmt *stmt);
 
-        ObjPtr evaluate(Expr *expr);
+        Value evaluate(Expr *expr);
+
+        /// execute() and evaluate() under --hotspots. Kept out of line so
+        /// the uninstrumented path stays small.
+        __attribute__((noinline)) void executeTimed(Stmt *stmt);
+        __attribute__((noinline)) void evaluateTimed(Expr *expr);
+        __attribute__((noinline)) void executeTailCallTimed(StmtList &body, Env *new_env);
+
+        /// Evaluates the callee and arguments of `expr` onto the temp stack
+        /// and returns where the callee is.
+        size_t pushCall(CallExpr *expr);
+
+        /// Returns the function pushCall() left at `base`, after checking it
+        /// is one and takes `argCount` arguments, and materializes its body
+        /// if that was lazily parsed.
+        FuncObj *calleeAt(size_t base, size_t argCount, size_t line);
+
+        void call(FuncObj *callfunc, const Value *arguments);
+
+        /// Returns a frame for `callfunc` holding its arguments, which
+        /// calleeAt() has checked there is one of for each parameter.
+        Env *enterFrame(FuncObj *callfunc, const Value *arguments);
+
+        /// Natives take their arguments straight from the temp stack.
+        void callNative(NativeObj *native, size_t argCount, const Value *arguments, size_t line);
+
+        void define(int slot, const Token *name, Value value_);
 
-        void call(FuncObj *callfunc, ObjList &&arguments);
+        void sample();
 
         /// Expressions.
         void visit(AssignExpr *expr) override;
@@ -42,10 +171,14 @@ namespace lox
         void visit(LogicExpr *expr) override;
         void visit(UnaryExpr *expr) override;
         void visit(VarExpr *expr) override;
+        void visit(AddAssignExpr *expr) override;
+        void visit(CompareConstExpr *expr) override;
 
         /// Statements.
         void visit(BlockStmt *stmt) override;
-        void executeBlock(StmtList &statements_, EnvPtr env_);
+        void executeBlock(StmtList &statements_, Env *env_);
+        Env *acquireEnv(Env *enclosing, size_t slotCount);
+        void releaseEnv(Env *scope);
         void visit(ExprStmt *stmt) override;
         void visit(FuncStmt *stmt) override;
         void visit(IfStmt *stmt) override;
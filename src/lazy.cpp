@@ -0,0 +1,37 @@
+#include "error_handler.hpp"
+#include "lazy.hpp"
+#include "optimizer.hpp"
+#include "parser.hpp"
+#include "resolver.hpp"
+
+using namespace lox;
+
+void LazyBodies::materialize(FuncStmt *function, size_t line)
+{
+    Ast *ast = function->lazyAst;
+    ErrorHandler errors;
+
+    Parser::materialize(function, errors);
+    if (!errors.hasError())
+    {
+        Resolver resolver(errors);
+        resolver.resolve(function);
+    }
+
+    if (errors.hasError())
+    {
+        errors.report();
+        function->body.clear();
+        function->lazyAst = ast;
+        throw RuntimeError(line, "Could not compile function '" + function->name->lexeme() + "'.");
+    }
+
+    // Lazy bodies only exist for the tree-walker, so fusing is always on.
+    if (optimize)
+    {
+        Optimizer optimizer(*ast, heap, true);
+        optimizer.optimize(function->body);
+        nodesEliminated += optimizer.eliminated();
+    }
+    materialized++;
+}
@@ -0,0 +1,36 @@
+#ifndef LAZY_HPP
+#define LAZY_HPP
+
+#include "ast.hpp"
+#include "heap.hpp"
+
+namespace lox
+{
+
+    /// Finishes the top-level function bodies a lazy Parser skipped, the
+    /// first time each one is called, by parsing, resolving and optimizing
+    /// it the way the rest of the program was.
+    class LazyBodies
+    {
+    public:
+        /// Bodies skipped by the parser, and how many of them were needed.
+        size_t deferred = 0;
+        size_t materialized = 0;
+
+        /// AST nodes the optimizer removed from materialized bodies.
+        size_t nodesEliminated = 0;
+
+        LazyBodies(Heap &heap_, bool optimize_) : heap(heap_), optimize(optimize_) {}
+
+        /// Throws a RuntimeError at `line`, the call that needed the body,
+        /// after reporting the compile errors if the body turns out to be
+        /// invalid; the function then stays lazy.
+        void materialize(FuncStmt *function, size_t line);
+
+    private:
+        Heap &heap;
+        bool optimize;
+    };
+} // namespace lox
+
+#endif
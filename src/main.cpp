@@ -1,67 +1,114 @@
-#include <fstream>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
-#include <sstream>
 #include <string>
 #include <vector>
 
-#include "scanner.hpp"
-#include "ast.hpp"
-#include "parser.hpp"
-#include "interpreter.hpp"
-#include "error_handler.hpp"
+#include "cache.hpp"
+#include "runtime.hpp"
+#include "source.hpp"
 
 namespace lox
 {
 
-    static void run(const std::string &source, Interpreter &interpreter)
+    static bool runFile(const Options &options)
     {
-        ErrorHandler errors;
-
-        Scanner scanner(source, errors);
-        TokenList tokens = scanner.scanTokens();
-
-        Parser parser(std::move(tokens), errors);
-        StmtList stmts = parser.parse();
-
-        interpreter.interpret(stmts);
-    }
-
-    static void runFile(const std::string &path)
-    {
-        std::ifstream file(path);
-        std::ostringstream ostr;
-        ostr << file.rdbuf();
-        file.close();
+        SourceBuffer source;
+        if (!source.open(options.path))
+        {
+            std::cerr << "Could not open file '" << options.path << "'." << std::endl;
+            return false;
+        }
 
-        Interpreter interpreter;
-        run(ostr.str(), interpreter);
+        Runtime runtime(options);
+        run(std::move(source), runtime, options.cache ? AstCache::pathFor(options.path, options.cacheDir) : std::string());
+        return true;
     }
 
-    static void runPrompt()
+    static void runPrompt(const Options &options)
     {
-        Interpreter interpreter;
+        Runtime runtime(options);
         while (true)
         {
             std::cout << ">";
 
             std::string line;
-            getline(std::cin, line);
-            run(line, interpreter);
+            if (!getline(std::cin, line))
+                break;
+            run(SourceBuffer(std::move(line)), runtime);
         }
     }
+
+    static bool parseOptions(int argc, const char **argv, Options &options)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            const char *arg = argv[i];
+            if (std::strcmp(arg, "--engine=tree") == 0)
+                options.engine = Engine::Tree;
+            else if (std::strcmp(arg, "--engine=vm") == 0)
+                options.engine = Engine::VM;
+            else if (std::strcmp(arg, "--gc-stats") == 0)
+                options.gcStats = true;
+            else if (std::strncmp(arg, "--gc-threshold=", 15) == 0)
+                options.gcThreshold = std::strtoul(arg + 15, nullptr, 10);
+            else if (std::strncmp(arg, "--gc-growth=", 12) == 0)
+                options.gcGrowth = std::strtod(arg + 12, nullptr);
+            else if (std::strcmp(arg, "--profile") == 0)
+                options.profilePath = "ccloxx.folded";
+            else if (std::strncmp(arg, "--profile=", 10) == 0)
+                options.profilePath = arg + 10;
+            else if (std::strcmp(arg, "--hotspots") == 0)
+                options.hotspots = true;
+            else if (std::strcmp(arg, "--ic-stats") == 0)
+                options.icStats = true;
+            else if (std::strcmp(arg, "--no-optimize") == 0)
+                options.optimize = false;
+            else if (std::strcmp(arg, "--opt-stats") == 0)
+                options.optStats = true;
+            else if (std::strncmp(arg, "--max-depth=", 12) == 0)
+            {
+                char *end;
+                options.maxDepth = std::strtoul(arg + 12, &end, 10);
+                if (options.maxDepth == 0 || *end != '\0')
+                    return false;
+            }
+            else if (std::strcmp(arg, "--lazy-parse") == 0)
+                options.lazyParse = true;
+            else if (std::strcmp(arg, "--cache") == 0)
+                options.cache = true;
+            else if (std::strncmp(arg, "--cache=", 8) == 0)
+            {
+                options.cache = true;
+                options.cacheDir = arg + 8;
+            }
+            else if (arg[0] == '-' || !options.path.empty())
+                return false;
+            else
+                options.path = arg;
+        }
+        return true;
+    }
 } // namespace lox
 
 int main(int argc, const char **argv)
 {
-    if (argc > 2)
-        std::cerr << "Usage : lox [filename]" << std::endl;
-    else if (argc == 2)
+    lox::Options options;
+    if (!lox::parseOptions(argc, argv, options))
     {
-        lox::runFile(argv[1]);
+        std::cerr << "Usage : lox [--engine=tree|vm] [--gc-stats] [--gc-threshold=<bytes>] "
+                     "[--gc-growth=<factor>] [--profile[=<file>]] [--hotspots] [--ic-stats] "
+                     "[--no-optimize] [--opt-stats] [--cache[=<dir>]] [--lazy-parse] [--max-depth=<calls>] [filename]"
+                  << std::endl;
+        return 64;
     }
-    else
+
+    if (!options.path.empty())
     {
-        lox::runPrompt();
+        if (!lox::runFile(options))
+            return 66;
     }
+    else
+        lox::runPrompt(options);
     return 0;
-}
\ No newline at end of file
+}
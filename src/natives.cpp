@@ -0,0 +1,88 @@
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include "natives.hpp"
+
+using namespace lox;
+
+namespace
+{
+    double numberArg(const Value *args, const char *function)
+    {
+        if (!args[0].isNum())
+            throw NativeError(std::string(function) + "() expects a number.");
+        return args[0].asNum();
+    }
+
+    Value clockNative(Heap &, const Value *)
+    {
+        return Value(static_cast<double>(std::clock()) / CLOCKS_PER_SEC);
+    }
+
+    Value sqrtNative(Heap &, const Value *args)
+    {
+        return Value(std::sqrt(numberArg(args, "sqrt")));
+    }
+
+    Value floorNative(Heap &, const Value *args)
+    {
+        return Value(std::floor(numberArg(args, "floor")));
+    }
+
+    Value lenNative(Heap &, const Value *args)
+    {
+        if (!args[0].isStr())
+            throw NativeError("len() expects a string.");
+        return Value(static_cast<double>(args[0].asStr()->length));
+    }
+
+    Value strNative(Heap &heap, const Value *args)
+    {
+        if (args[0].isStr())
+            return args[0];
+        return Value(heap.intern(args[0].toString()));
+    }
+
+    /// Parses the whole string as a number; anything else gives nil.
+    Value numNative(Heap &, const Value *args)
+    {
+        if (args[0].isNum())
+            return args[0];
+        if (!args[0].isStr())
+            return Value();
+
+        const std::string &chars = args[0].asStr()->chars();
+        char *end = nullptr;
+        double number = std::strtod(chars.c_str(), &end);
+        if (chars.empty() || end != chars.c_str() + chars.size())
+            return Value();
+        return Value(number);
+    }
+
+    struct NativeDef
+    {
+        const char *name;
+        size_t arity;
+        NativeFn function;
+    };
+
+    const NativeDef nativeTable[] = {
+        {"clock", 0, clockNative},
+        {"sqrt", 1, sqrtNative},
+        {"floor", 1, floorNative},
+        {"len", 1, lenNative},
+        {"str", 1, strNative},
+        {"num", 1, numNative},
+    };
+} // namespace
+
+void lox::defineNatives(Heap &heap, const std::function<void(StrObj *, Value)> &define)
+{
+    for (const NativeDef &native : nativeTable)
+    {
+        StrObj *name = heap.internPinned(native.name, std::strlen(native.name));
+        define(name, Value(heap.make<NativeObj>(native.name, native.arity, native.function)));
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef NATIVES_HPP
+#define NATIVES_HPP
+
+#include <functional>
+#include <stdexcept>
+#include <string>
+
+#include "heap.hpp"
+#include "object.hpp"
+
+namespace lox
+{
+
+    /// Thrown by a native given arguments it cannot handle. The engine
+    /// reports it as a RuntimeError on the line of the call.
+    class NativeError : public std::runtime_error
+    {
+    public:
+        NativeError(const std::string &message_) : std::runtime_error(message_) {}
+    };
+
+    /// Creates each built-in function (clock, sqrt, floor, len, str, num)
+    /// and hands it to `define` with its interned name. Each one is defined
+    /// before the next is allocated, so the collector always sees it.
+    void defineNatives(Heap &heap, const std::function<void(StrObj *, Value)> &define);
+} // namespace lox
+
+#endif
@@ -10,161 +10,273 @@ namespace lox
 {
 
     class Env;
+    class Heap;
+    class StrObj;
     class Interpreter;
 
     enum class ObjectType
     {
-        BoolType,
-        NumType,
-        NilType,
         StrType,
         FuncType,
+        ClosureType,
+        UpvalueType,
+        EnvType,
+        NativeType,
     };
 
+    /// Heap-allocated Lox objects. Numbers, bools and nil never live here;
+    /// they are stored inline in a Value. Every object is created through
+    /// Heap::make and owned by the Heap, which links them into one list.
     class Object
     {
     public:
         ObjectType type;
+        bool marked;
+        Object *next;
+
+        Object(ObjectType type_) : type(type_), marked(false), next(nullptr) {}
+
+        virtual ~Object() {}
 
-        Object(ObjectType type_) : type(type_) {}
+        /// Marks every object this one refers to. Defined in heap.cpp.
+        virtual void trace(Heap &) {}
+
+        /// Bytes owned by this object, used to pace collections.
+        virtual size_t size() const = 0;
 
         virtual bool isTrue() const { return true; }
 
         virtual bool equals(Object *other) const = 0;
 
-        virtual std::unique_ptr<Object> clone() const = 0;
-
         virtual std::string toString() const = 0;
     };
 
-    class NumObj : public Object
+    /// Strings are interned by the Heap: two interned StrObjs never hold the
+    /// same characters, so comparing them is comparing pointers.
+    ///
+    /// Concatenations of ROPE_MIN or more characters are ropes instead: an
+    /// uninterned StrObj that only refers to its two halves, so building a
+    /// string piece by piece copies nothing until its characters are needed.
+    /// chars() then flattens the rope into `value` once and lets go of the
+    /// halves. Ropes compare by their characters.
+    class StrObj : public Object
     {
     public:
-        double value;
+        static const size_t ROPE_MIN = 64;
 
-        NumObj(double value_) : Object(ObjectType::NumType), value(value_) {}
+        /// The characters; empty for a rope until chars() flattens it.
+        /// Names and literals are never ropes and are read here directly.
+        mutable std::string value;
 
-        bool equals(Object *other) const override
-        {
-            if (other->type != ObjectType::NumType)
-                return false;
-            return value == static_cast<NumObj *>(other)->value;
-        }
+        size_t length;
+        bool pinned;
+        bool interned;
 
-        std::unique_ptr<Object> clone() const override
-        {
-            return std::unique_ptr<NumObj>(new NumObj(value));
-        }
+        StrObj(const std::string &value_)
+            : Object(ObjectType::StrType), value(value_), length(value.size()), pinned(false), interned(false) {}
 
-        std::string toString() const override
+        StrObj(std::string &&value_)
+            : Object(ObjectType::StrType), value(std::move(value_)), length(value.size()), pinned(false), interned(false) {}
+
+        StrObj(StrObj *left_, StrObj *right_)
+            : Object(ObjectType::StrType), length(left_->length + right_->length),
+              pinned(false), interned(false), left(left_), right(right_) {}
+
+        const std::string &chars() const
         {
-            return std::string(std::to_string(value));
+            if (left)
+                flatten();
+            return value;
         }
-    };
 
-    class StrObj : public Object
-    {
-    public:
-        std::string value;
+        void trace(Heap &heap) override;
 
-        StrObj(const std::string &value_) : Object(ObjectType::StrType), value(value_) {}
+        size_t size() const override { return sizeof(StrObj) + value.capacity(); }
 
         bool equals(Object *other) const override
         {
+            if (other == this)
+                return true;
             if (other->type != ObjectType::StrType)
                 return false;
-            return value == static_cast<StrObj *>(other)->value;
-        }
 
-        std::unique_ptr<Object> clone() const override
-        {
-            return std::unique_ptr<StrObj>(new StrObj(value));
+            auto *string = static_cast<StrObj *>(other);
+            if (interned && string->interned)
+                return false;
+            return length == string->length && chars() == string->chars();
         }
 
         std::string toString() const override
         {
-            return value;
+            return chars();
         }
+
+    private:
+        /// The halves of a rope that has not been flattened yet.
+        mutable StrObj *left = nullptr;
+        mutable StrObj *right = nullptr;
+
+        void flatten() const;
     };
 
-    class BoolObj : public Object
+    class FuncObj : public Object
     {
     public:
-        bool value;
+        FuncStmt *declaration;
 
-        BoolObj(bool value_) : Object(ObjectType::BoolType), value(value_) {}
+        Env *closure;
 
-        bool isTrue() const override { return value; }
+        FuncObj(FuncStmt *declare_, Env *closure_) : Object(ObjectType::FuncType),
+                                                     declaration(declare_),
+                                                     closure(closure_) {}
 
-        bool equals(Object *other) const override
-        {
-            if (other->type != ObjectType::BoolType)
-                return false;
-            return value == static_cast<BoolObj *>(other)->value;
-        }
+        void trace(Heap &heap) override;
 
-        std::unique_ptr<Object> clone() const override
-        {
-            return std::unique_ptr<BoolObj>(new BoolObj(value));
-        }
+        size_t size() const override { return sizeof(FuncObj); }
+
+        bool isTrue() const override { return false; }
+
+        bool equals(Object *other) const override { return other->type == ObjectType::FuncType; }
 
         std::string toString() const override
         {
-            return std::to_string(value);
+            return "<fn " + declaration->name->lexeme() + ">";
         }
+
+        size_t arity()
+        {
+            return declaration->params.size();
+        };
     };
 
-    class NilObj : public Object
+    /// A built-in function. `args` points at exactly `arity` values in the
+    /// caller's frame, so no argument list is built for the call.
+    using NativeFn = Value (*)(Heap &heap, const Value *args);
+
+    class NativeObj : public Object
     {
     public:
-        NilObj() : Object(ObjectType::NilType) {}
+        const char *name;
+        size_t arity;
+        NativeFn function;
 
-        bool isTrue() const override { return false; }
+        NativeObj(const char *name_, size_t arity_, NativeFn function_) : Object(ObjectType::NativeType),
+                                                                          name(name_),
+                                                                          arity(arity_),
+                                                                          function(function_) {}
 
-        bool equals(Object *other) const override { return other->type == ObjectType::NilType; }
+        size_t size() const override { return sizeof(NativeObj); }
 
-        std::unique_ptr<Object> clone() const override
-        {
-            return std::unique_ptr<NilObj>();
-        }
+        bool isTrue() const override { return false; }
+
+        bool equals(Object *other) const override { return other == this; }
 
         std::string toString() const override
         {
-            return "Nil";
+            return std::string("<native fn ") + name + ">";
         }
     };
 
-    class FuncObj : public Object
+    /*****************************************/
+    // Value
+
+    enum class ValueType : unsigned char
+    {
+        NilType,
+        BoolType,
+        NumType,
+        ObjType,
+    };
+
+    /// A 16-byte tagged value. Scalars are held inline; strings and functions
+    /// are plain pointers into the Heap, so copying a Value is two words.
+    class Value
     {
     public:
-        FuncStmt *declaration;
+        ValueType type;
 
-        std::shared_ptr<Env> closure;
+        union
+        {
+            bool boolean;
+            double number;
+            Object *object;
+        } as;
 
-        FuncObj(FuncStmt *declare_, std::shared_ptr<Env> closure_) : Object(ObjectType::FuncType),
-                                                                     declaration(declare_),
-                                                                     closure(closure_) {}
+        Value() : type(ValueType::NilType) { as.object = nullptr; }
 
-        bool isTrue() const override { return false; }
+        Value(bool boolean_) : type(ValueType::BoolType) { as.boolean = boolean_; }
 
-        bool equals(Object *other) const override { return other->type == ObjectType::FuncType; }
+        Value(double number_) : type(ValueType::NumType) { as.number = number_; }
+
+        explicit Value(Object *object_) : type(ValueType::ObjType) { as.object = object_; }
+
+        bool isNil() const { return type == ValueType::NilType; }
+        bool isBool() const { return type == ValueType::BoolType; }
+        bool isNum() const { return type == ValueType::NumType; }
+        bool isObj() const { return type == ValueType::ObjType; }
+        bool isStr() const { return isObj() && as.object->type == ObjectType::StrType; }
+        bool isFunc() const { return isObj() && as.object->type == ObjectType::FuncType; }
+        bool isNative() const { return isObj() && as.object->type == ObjectType::NativeType; }
+
+        double asNum() const { return as.number; }
+        StrObj *asStr() const { return static_cast<StrObj *>(as.object); }
+        FuncObj *asFunc() const { return static_cast<FuncObj *>(as.object); }
+        NativeObj *asNative() const { return static_cast<NativeObj *>(as.object); }
 
-        std::unique_ptr<Object> clone() const override
+        bool isTrue() const
         {
-            return std::unique_ptr<FuncObj>(new FuncObj(declaration, closure));
+            switch (type)
+            {
+            case ValueType::NilType:
+                return false;
+            case ValueType::BoolType:
+                return as.boolean;
+            case ValueType::NumType:
+                return true;
+            case ValueType::ObjType:
+                return as.object->isTrue();
+            }
+            return false;
         }
 
-        std::string toString() const override
+        bool equals(const Value &other) const
         {
-            return "<fn " + declaration->name->lexeme + ">";
+            if (type != other.type)
+                return false;
+
+            switch (type)
+            {
+            case ValueType::NilType:
+                return true;
+            case ValueType::BoolType:
+                return as.boolean == other.as.boolean;
+            case ValueType::NumType:
+                return as.number == other.as.number;
+            case ValueType::ObjType:
+                return as.object == other.as.object || as.object->equals(other.as.object);
+            }
+            return false;
         }
 
-        size_t arity()
+        std::string toString() const
         {
-            return declaration->params.size();
-        };
+            switch (type)
+            {
+            case ValueType::NilType:
+                return "Nil";
+            case ValueType::BoolType:
+                return std::to_string(as.boolean);
+            case ValueType::NumType:
+                return std::to_string(as.number);
+            case ValueType::ObjType:
+                return as.object->toString();
+            }
+            return "";
+        }
     };
 
+    static_assert(sizeof(Value) == 16, "Value should stay two words wide");
+
 } // namespace lox
 
-#endif
\ No newline at end of file
+#endif
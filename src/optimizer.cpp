@@ -0,0 +1,439 @@
+#include <string>
+
+#include "optimizer.hpp"
+
+using namespace lox;
+
+namespace
+{
+    /// Counts the nodes of a subtree, to report what the optimizer removed.
+    class NodeCounter : public ExprVisitor, StmtVisitor
+    {
+    public:
+        size_t count = 0;
+
+        void add(Expr *expr)
+        {
+            if (expr)
+                expr->accept(*this);
+        }
+
+        void add(Stmt *stmt)
+        {
+            if (stmt)
+                stmt->accept(*this);
+        }
+
+        void add(std::vector<Stmt *> &statements)
+        {
+            for (auto &stmt : statements)
+                add(stmt);
+        }
+
+        void visit(AssignExpr *expr) override { count++, add(expr->value); }
+        void visit(BinaryExpr *expr) override { count++, add(expr->left), add(expr->right); }
+        void visit(CallExpr *expr) override
+        {
+            count++;
+            add(expr->callee);
+            for (auto &arg : expr->arguments)
+                add(arg);
+        }
+        void visit(GroupingExpr *expr) override { count++, add(expr->expression); }
+        void visit(NilLiteralExpr *) override { count++; }
+        void visit(BoolLiteralExpr *) override { count++; }
+        void visit(NumLiteralExpr *) override { count++; }
+        void visit(StrLiteralExpr *) override { count++; }
+        void visit(LogicExpr *expr) override { count++, add(expr->left), add(expr->right); }
+        void visit(UnaryExpr *expr) override { count++, add(expr->right); }
+        void visit(VarExpr *) override { count++; }
+        void visit(AddAssignExpr *expr) override { count++, add(expr->operand); }
+        void visit(CompareConstExpr *) override { count++; }
+
+        void visit(BlockStmt *stmt) override { count++, add(stmt->statements); }
+        void visit(ExprStmt *stmt) override { count++, add(stmt->expression); }
+        void visit(FuncStmt *stmt) override { count++, add(stmt->body); }
+        void visit(IfStmt *stmt) override { count++, add(stmt->condition), add(stmt->thenBranch), add(stmt->elseBranch); }
+        void visit(PrintStmt *stmt) override { count++, add(stmt->expression); }
+        void visit(ReturnStmt *stmt) override { count++, add(stmt->value); }
+        void visit(VarStmt *stmt) override { count++, add(stmt->initializer); }
+        void visit(WhileStmt *stmt) override { count++, add(stmt->condition), add(stmt->body), add(stmt->increment); }
+    };
+
+    template <typename Node>
+    size_t countNodes(Node *node)
+    {
+        NodeCounter counter;
+        counter.add(node);
+        return counter.count;
+    }
+} // namespace
+
+void Optimizer::optimize(StmtList &statements)
+{
+    size_t kept = 0;
+    for (auto &statement : statements)
+    {
+        Stmt *optimized = optimize(statement);
+        if (optimized)
+            statements[kept++] = optimized;
+    }
+    statements.resize(kept);
+}
+
+Expr *Optimizer::optimize(Expr *expr_)
+{
+    if (!expr_)
+        return nullptr;
+
+    expr = expr_;
+    expr_->accept(*this);
+    return expr;
+}
+
+Stmt *Optimizer::optimize(Stmt *stmt_)
+{
+    if (!stmt_)
+        return nullptr;
+
+    stmt = stmt_;
+    stmt_->accept(*this);
+    return stmt;
+}
+
+Stmt *Optimizer::optimizeRequired(Stmt *stmt_)
+{
+    Stmt *optimized = optimize(stmt_);
+    if (optimized || !stmt_)
+        return optimized;
+
+    eliminatedNodes--;
+    return make<BlockStmt>(stmt_->line, StmtList());
+}
+
+Expr *Optimizer::replace(Expr *node, Expr *replacement)
+{
+    eliminatedNodes += countNodes(node) - countNodes(replacement);
+    return replacement;
+}
+
+bool Optimizer::isConstant(Expr *node) const
+{
+    // A missing operand, left by a syntax error, is never constant.
+    if (!node)
+        return false;
+
+    switch (node->type)
+    {
+    case ExprType::NilLiteralExprType:
+    case ExprType::BoolLiteralExprType:
+    case ExprType::NumLiteralExprType:
+    case ExprType::StrLiteralExprType:
+        return true;
+    default:
+        return false;
+    }
+}
+
+Value Optimizer::constantValue(Expr *node) const
+{
+    switch (node->type)
+    {
+    case ExprType::BoolLiteralExprType:
+        return Value(static_cast<BoolLiteralExpr *>(node)->literal);
+    case ExprType::NumLiteralExprType:
+        return Value(static_cast<NumLiteralExpr *>(node)->literal);
+    case ExprType::StrLiteralExprType:
+        return Value(static_cast<StrLiteralExpr *>(node)->literal);
+    default:
+        return Value();
+    }
+}
+
+Expr *Optimizer::makeLiteral(const Value &value, uint32_t line)
+{
+    switch (value.type)
+    {
+    case ValueType::BoolType:
+        return make<BoolLiteralExpr>(line, value.as.boolean);
+    case ValueType::NumType:
+        return make<NumLiteralExpr>(line, value.as.number);
+    case ValueType::ObjType:
+        return make<StrLiteralExpr>(line, value.asStr());
+    default:
+        return make<NilLiteralExpr>(line);
+    }
+}
+
+/*****************************************/
+// Expressions
+
+void Optimizer::visit(AssignExpr *expr_)
+{
+    expr_->value = optimize(expr_->value);
+    expr = expr_;
+
+    if (!fuse || !expr_->value || expr_->value->type != ExprType::BinaryExprType)
+        return;
+
+    auto *binary = static_cast<BinaryExpr *>(expr_->value);
+    if (binary->op->type != TokenType::PLUS || !binary->left || binary->left->type != ExprType::VarExprType)
+        return;
+
+    auto *target = static_cast<VarExpr *>(binary->left);
+    if (target->name->literal.string != expr_->name->literal.string)
+        return;
+
+    auto *fused = make<AddAssignExpr>(expr_->line, expr_->name, binary->right);
+    fused->depth = expr_->depth;
+    fused->slot = expr_->slot;
+    expr = replace(expr_, fused);
+}
+
+void Optimizer::visit(BinaryExpr *expr_)
+{
+    expr_->left = optimize(expr_->left);
+    expr_->right = optimize(expr_->right);
+    expr = expr_;
+
+    if (fuse)
+        fuseComparison(expr_);
+
+    if (!isConstant(expr_->left) || !isConstant(expr_->right))
+        return;
+
+    Value left = constantValue(expr_->left);
+    Value right = constantValue(expr_->right);
+    bool numbers = left.isNum() && right.isNum();
+    Value result;
+
+    switch (expr_->op->type)
+    {
+    case TokenType::BANG_EQUAL:
+        result = Value(!left.equals(right));
+        break;
+    case TokenType::EQUAL_EQUAL:
+        result = Value(left.equals(right));
+        break;
+    case TokenType::PLUS:
+        if (numbers)
+            result = Value(left.asNum() + right.asNum());
+        else if (left.isStr() && right.isStr())
+        {
+            std::string chars = left.asStr()->value + right.asStr()->value;
+            result = Value(heap.internPinned(chars.data(), chars.size()));
+        }
+        else
+            return;
+        break;
+    default:
+        if (!numbers)
+            return;
+
+        switch (expr_->op->type)
+        {
+        case TokenType::GREATER:
+            result = Value(left.asNum() > right.asNum());
+            break;
+        case TokenType::GREATER_EQUAL:
+            result = Value(left.asNum() >= right.asNum());
+            break;
+        case TokenType::LESS:
+            result = Value(left.asNum() < right.asNum());
+            break;
+        case TokenType::LESS_EQUAL:
+            result = Value(left.asNum() <= right.asNum());
+            break;
+        case TokenType::MINUS:
+            result = Value(left.asNum() - right.asNum());
+            break;
+        case TokenType::SLASH:
+            result = Value(left.asNum() / right.asNum());
+            break;
+        case TokenType::STAR:
+            result = Value(left.asNum() * right.asNum());
+            break;
+        default:
+            return;
+        }
+    }
+
+    expr = replace(expr_, makeLiteral(result, expr_->line));
+}
+
+void Optimizer::fuseComparison(BinaryExpr *expr_)
+{
+    switch (expr_->op->type)
+    {
+    case TokenType::GREATER:
+    case TokenType::GREATER_EQUAL:
+    case TokenType::LESS:
+    case TokenType::LESS_EQUAL:
+        break;
+    default:
+        return;
+    }
+
+    if (!expr_->left || !expr_->right)
+        return;
+    if (expr_->left->type != ExprType::VarExprType || expr_->right->type != ExprType::NumLiteralExprType)
+        return;
+
+    auto *variable = static_cast<VarExpr *>(expr_->left);
+    auto *fused = make<CompareConstExpr>(expr_->line, variable->name, expr_->op,
+                                         static_cast<NumLiteralExpr *>(expr_->right)->literal);
+    fused->depth = variable->depth;
+    fused->slot = variable->slot;
+    expr = replace(expr_, fused);
+}
+
+void Optimizer::visit(CallExpr *expr_)
+{
+    expr_->callee = optimize(expr_->callee);
+    for (auto &arg : expr_->arguments)
+        arg = optimize(arg);
+    expr = expr_;
+}
+
+void Optimizer::visit(GroupingExpr *expr_)
+{
+    expr = replace(expr_, optimize(expr_->expression));
+}
+
+void Optimizer::visit(NilLiteralExpr *expr_)
+{
+    expr = expr_;
+}
+
+void Optimizer::visit(BoolLiteralExpr *expr_)
+{
+    expr = expr_;
+}
+
+void Optimizer::visit(StrLiteralExpr *expr_)
+{
+    expr = expr_;
+}
+
+void Optimizer::visit(NumLiteralExpr *expr_)
+{
+    expr = expr_;
+}
+
+void Optimizer::visit(LogicExpr *expr_)
+{
+    expr_->left = optimize(expr_->left);
+    expr_->right = optimize(expr_->right);
+    expr = expr_;
+
+    if (!isConstant(expr_->left))
+        return;
+
+    // A short-circuited `and`/`or` yields the left operand's truthiness as
+    // a bool; otherwise it yields the right operand.
+    bool truthy = constantValue(expr_->left).isTrue();
+    bool shortCircuits = expr_->opr->type == TokenType::OR ? truthy : !truthy;
+    if (shortCircuits)
+        expr = replace(expr_, make<BoolLiteralExpr>(expr_->line, truthy));
+    else
+        expr = replace(expr_, expr_->right);
+}
+
+void Optimizer::visit(UnaryExpr *expr_)
+{
+    expr_->right = optimize(expr_->right);
+    expr = expr_;
+
+    if (!isConstant(expr_->right))
+        return;
+
+    Value right = constantValue(expr_->right);
+    if (expr_->op->type == TokenType::BANG)
+        expr = replace(expr_, make<BoolLiteralExpr>(expr_->line, !right.isTrue()));
+    else if (expr_->op->type == TokenType::MINUS && right.isNum())
+        expr = replace(expr_, make<NumLiteralExpr>(expr_->line, -right.asNum()));
+}
+
+void Optimizer::visit(VarExpr *expr_)
+{
+    expr = expr_;
+}
+
+void Optimizer::visit(AddAssignExpr *expr_)
+{
+    expr_->operand = optimize(expr_->operand);
+    expr = expr_;
+}
+
+void Optimizer::visit(CompareConstExpr *expr_)
+{
+    expr = expr_;
+}
+
+/*****************************************/
+// Statements
+
+void Optimizer::visit(BlockStmt *stmt_)
+{
+    optimize(stmt_->statements);
+    stmt = stmt_;
+}
+
+void Optimizer::visit(ExprStmt *stmt_)
+{
+    stmt_->expression = optimize(stmt_->expression);
+    stmt = stmt_;
+}
+
+void Optimizer::visit(FuncStmt *stmt_)
+{
+    optimize(stmt_->body);
+    stmt = stmt_;
+}
+
+void Optimizer::visit(IfStmt *stmt_)
+{
+    stmt_->condition = optimize(stmt_->condition);
+    stmt_->thenBranch = optimizeRequired(stmt_->thenBranch);
+    stmt_->elseBranch = optimize(stmt_->elseBranch);
+    stmt = stmt_;
+
+    if (!isConstant(stmt_->condition))
+        return;
+
+    Stmt *taken = constantValue(stmt_->condition).isTrue() ? stmt_->thenBranch : stmt_->elseBranch;
+    eliminatedNodes += countNodes(static_cast<Stmt *>(stmt_)) - countNodes(taken);
+    stmt = taken;
+}
+
+void Optimizer::visit(PrintStmt *stmt_)
+{
+    stmt_->expression = optimize(stmt_->expression);
+    stmt = stmt_;
+}
+
+void Optimizer::visit(ReturnStmt *stmt_)
+{
+    stmt_->value = optimize(stmt_->value);
+    stmt = stmt_;
+}
+
+void Optimizer::visit(VarStmt *stmt_)
+{
+    stmt_->initializer = optimize(stmt_->initializer);
+    stmt = stmt_;
+}
+
+void Optimizer::visit(WhileStmt *stmt_)
+{
+    stmt_->condition = optimize(stmt_->condition);
+    stmt_->body = optimizeRequired(stmt_->body);
+    stmt_->increment = optimize(stmt_->increment);
+    stmt = stmt_;
+
+    if (isConstant(stmt_->condition) && !constantValue(stmt_->condition).isTrue())
+    {
+        eliminatedNodes += countNodes(static_cast<Stmt *>(stmt_));
+        stmt = nullptr;
+    }
+}
@@ -0,0 +1,95 @@
+#ifndef OPTIMIZER_HPP
+#define OPTIMIZER_HPP
+
+#include "ast.hpp"
+#include "heap.hpp"
+#include "parser.hpp"
+
+namespace lox
+{
+
+    /// Rewrites a resolved program before it runs: folds operators whose
+    /// operands are literals, drops GroupingExprs, and removes IfStmt
+    /// branches and while loops whose conditions are constant.
+    ///
+    /// Folding only happens where both engines would compute the same value
+    /// without a runtime error, so e.g. `-"a"` is left for the VM to report.
+    /// Replacement nodes are allocated in the program's arena.
+    ///
+    /// With `fuse` set, which is only done for the tree-walker, common loop
+    /// shapes are also rewritten into fused nodes: `x = x + y` becomes an
+    /// AddAssignExpr and `i < 10` a CompareConstExpr.
+    class Optimizer : public ExprVisitor, StmtVisitor
+    {
+    public:
+        Optimizer(Ast &ast_, Heap &heap_, bool fuse_ = false) : ast(ast_), heap(heap_), fuse(fuse_) {}
+
+        void optimize(StmtList &statements);
+
+        /// Nodes removed from the tree so far, net of the ones added.
+        size_t eliminated() const { return eliminatedNodes; }
+
+    private:
+        Ast &ast;
+        Heap &heap;
+        bool fuse;
+        size_t eliminatedNodes = 0;
+
+        /// What the node just visited should be replaced with; null removes
+        /// a statement.
+        Expr *expr = nullptr;
+        Stmt *stmt = nullptr;
+
+        Expr *optimize(Expr *expr_);
+        Stmt *optimize(Stmt *stmt_);
+
+        /// For places that need exactly one statement, such as a loop body.
+        Stmt *optimizeRequired(Stmt *stmt_);
+
+        /// Replaces `node` with `replacement`, counting what was dropped.
+        Expr *replace(Expr *node, Expr *replacement);
+
+        bool isConstant(Expr *node) const;
+        Value constantValue(Expr *node) const;
+        Expr *makeLiteral(const Value &value, uint32_t line);
+
+        /// Replaces `expr_` with a CompareConstExpr when it compares a
+        /// variable against a number literal.
+        void fuseComparison(BinaryExpr *expr_);
+
+        template <typename T, typename... Args>
+        T *make(uint32_t line, Args &&... args)
+        {
+            T *node = ast.arena.make<T>(std::forward<Args>(args)...);
+            node->line = line;
+            return node;
+        }
+
+        /// Expressions.
+        void visit(AssignExpr *expr_) override;
+        void visit(BinaryExpr *expr_) override;
+        void visit(CallExpr *expr_) override;
+        void visit(GroupingExpr *expr_) override;
+        void visit(NilLiteralExpr *expr_) override;
+        void visit(BoolLiteralExpr *expr_) override;
+        void visit(StrLiteralExpr *expr_) override;
+        void visit(NumLiteralExpr *expr_) override;
+        void visit(LogicExpr *expr_) override;
+        void visit(UnaryExpr *expr_) override;
+        void visit(VarExpr *expr_) override;
+        void visit(AddAssignExpr *expr_) override;
+        void visit(CompareConstExpr *expr_) override;
+
+        /// Statements.
+        void visit(BlockStmt *stmt_) override;
+        void visit(ExprStmt *stmt_) override;
+        void visit(FuncStmt *stmt_) override;
+        void visit(IfStmt *stmt_) override;
+        void visit(PrintStmt *stmt_) override;
+        void visit(ReturnStmt *stmt_) override;
+        void visit(VarStmt *stmt_) override;
+        void visit(WhileStmt *stmt_) override;
+    };
+} // namespace lox
+
+#endif
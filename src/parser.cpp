@@ -4,40 +4,55 @@
 
 using namespace lox;
 
-StmtList Parser::parse()
+AstPtr Parser::parse()
 {
     while (!isAtEnd())
     {
         StmtPtr stmt = declaration();
         if (stmt)
-            statements.push_back(stmt);
+            ast->statements.push_back(stmt);
     }
 
-    return statements;
+    return std::move(owned);
+}
+
+void Parser::materialize(FuncStmt *function, ErrorHandler &error_)
+{
+    Parser parser(*function->lazyAst, error_);
+    parser.current = function->bodyStart;
+
+    function->body = parser.blocks();
+    function->lazyAst = nullptr;
 }
 
 StmtPtr Parser::declaration()
 {
+    uint32_t line = peek()->line;
+    StmtPtr stmt;
     if (match(TokenType::FUN))
-        return function("function");
+        stmt = function("function");
     else if (match(TokenType::VAR))
-        return varDecl();
+        stmt = varDecl();
+    else
+        return statement();
 
-    return statement();
+    if (stmt)
+        stmt->line = line;
+    return stmt;
 }
 
 StmtPtr Parser::function(const std::string &type)
 {
     TokenPtr name = consume(TokenType::IDENTIFIER, "Expect " + type + " name.");
     consume(TokenType::LEFT_PAREN, "Expect '(' after " + type + " name.");
-    TokenList parameters;
+    ParamList parameters;
     if (!check(TokenType::RIGHT_PAREN))
     {
         do
         {
             if (parameters.size() >= 127)
             {
-                errorhandler.add(peek()->line, peek()->lexeme, "Cannot have more than 127 arguments.");
+                errorhandler.add(peek()->line, peek()->lexeme(), "Cannot have more than 127 arguments.");
             }
             parameters.push_back(consume(TokenType::IDENTIFIER, "Expect parameter name."));
 
@@ -45,9 +60,23 @@ StmtPtr Parser::function(const std::string &type)
     }
     consume(TokenType::RIGHT_PAREN, "Expect ')' after parameters.");
 
-    consume(TokenType::LEFT_BRACE, "Expect '{' before " + type + " body.");
+    bool braced = consume(TokenType::LEFT_BRACE, "Expect '{' before " + type + " body.") != nullptr;
+
+    // Only top-level bodies can be resolved on their own later, since
+    // they see nothing but their parameters and the globals.
+    if (lazyBodies && nesting == 0 && braced)
+    {
+        size_t bodyStart = current;
+        skipBody();
+        FuncStmt *function = make<FuncStmt>(name, std::move(parameters), StmtList());
+        function->lazyAst = ast;
+        function->bodyStart = bodyStart;
+        deferredBodies++;
+        return function;
+    }
+
     StmtList body = blocks();
-    return std::make_shared<FuncStmt>(name, std::move(parameters), std::move(body));
+    return make<FuncStmt>(name, std::move(parameters), std::move(body));
 }
 
 StmtPtr Parser::varDecl()
@@ -61,27 +90,31 @@ StmtPtr Parser::varDecl()
         initializer = expression();
 
     consume(TokenType::SEMICOLON, "Expect ';' after variable declaration.");
-    return std::make_shared<VarStmt>(name, initializer);
+    return make<VarStmt>(name, initializer);
 }
 
 StmtPtr Parser::statement()
 {
+    uint32_t line = peek()->line;
+    StmtPtr stmt;
     if (match(TokenType::IF))
-        return ifStatement();
-    if (match(TokenType::FOR))
-        return forStatement();
-    if (match(TokenType::WHILE))
-        return whileStatement();
-    if (match(TokenType::PRINT))
-        return printStatement();
-    if (match(TokenType::RETURN))
-        return returnStatement();
-    if (match(TokenType::LEFT_BRACE))
-    {
-        return std::make_shared<BlockStmt>(std::move(blocks()));
-    }
+        stmt = ifStatement();
+    else if (match(TokenType::FOR))
+        stmt = forStatement();
+    else if (match(TokenType::WHILE))
+        stmt = whileStatement();
+    else if (match(TokenType::PRINT))
+        stmt = printStatement();
+    else if (match(TokenType::RETURN))
+        stmt = returnStatement();
+    else if (match(TokenType::LEFT_BRACE))
+        stmt = make<BlockStmt>(blocks());
+    else
+        stmt = expressionStatement();
 
-    return expressionStatement();
+    if (stmt)
+        stmt->line = line;
+    return stmt;
 }
 
 StmtPtr Parser::ifStatement()
@@ -99,11 +132,12 @@ StmtPtr Parser::ifStatement()
         elseBranch = statement();
     }
 
-    return std::make_shared<IfStmt>(condition, thenBranch, elseBranch);
+    return make<IfStmt>(condition, thenBranch, elseBranch);
 }
 
 StmtPtr Parser::forStatement()
 {
+    uint32_t line = previous()->line;
     if (!consume(TokenType::LEFT_PAREN, "Expect '(' after 'for'."))
         return nullptr;
 
@@ -129,34 +163,27 @@ StmtPtr Parser::forStatement()
     if (!consume(TokenType::SEMICOLON, "Expect ';' after loop condition."))
         return nullptr;
 
-    StmtPtr increment = nullptr;
+    ExprPtr increment = nullptr;
     if (!check(TokenType::RIGHT_PAREN))
     {
-        increment = std::make_shared<ExprStmt>(expression());
+        increment = expression();
     }
     if (!consume(TokenType::RIGHT_PAREN, "Expect ')' after for clauses."))
         return nullptr;
 
     StmtPtr body = statement();
 
-    if (increment != nullptr)
-    {
-        StmtList statements_;
-        statements_.push_back(body);
-        statements_.push_back(increment);
-        body = std::make_shared<BlockStmt>(std::move(statements_));
-    }
-
     if (condition == nullptr)
-        condition = std::make_shared<BoolLiteralExpr>(true);
-    body = std::make_shared<WhileStmt>(condition, body);
+        condition = make<BoolLiteralExpr>(true);
+    body = make<WhileStmt>(condition, body, increment);
+    body->line = line;
 
     if (initializer != nullptr)
     {
         StmtList statements_;
         statements_.push_back(initializer);
         statements_.push_back(body);
-        body = std::make_shared<BlockStmt>(std::move(statements_));
+        body = make<BlockStmt>(std::move(statements_));
     }
 
     return body;
@@ -171,7 +198,7 @@ StmtPtr Parser::whileStatement()
         return nullptr;
     StmtPtr body = statement();
 
-    return std::make_shared<WhileStmt>(condition, body);
+    return make<WhileStmt>(condition, body);
 }
 
 StmtPtr Parser::printStatement()
@@ -179,12 +206,12 @@ StmtPtr Parser::printStatement()
     ExprPtr value = expression();
     if (!consume(TokenType::SEMICOLON, "Expect ';' after value."))
         return nullptr;
-    return std::make_shared<PrintStmt>(value);
+    return make<PrintStmt>(value);
 }
 
 StmtPtr Parser::returnStatement()
 {
-    TokenPtr keyword = releasePrevious();
+    TokenPtr keyword = previous();
     ExprPtr value = nullptr;
     if (!check(TokenType::SEMICOLON))
     {
@@ -192,7 +219,7 @@ StmtPtr Parser::returnStatement()
     }
 
     consume(TokenType::SEMICOLON, "Expect ';' after return value.");
-    return std::make_shared<ReturnStmt>(keyword, value);
+    return make<ReturnStmt>(keyword, value);
 }
 
 StmtPtr Parser::expressionStatement()
@@ -200,28 +227,45 @@ StmtPtr Parser::expressionStatement()
     ExprPtr expr = expression();
     if (!consume(TokenType::SEMICOLON, "Expect ';' after expression."))
         return nullptr;
-    return std::make_shared<ExprStmt>(expr);
+    return make<ExprStmt>(expr);
 }
 
 StmtList Parser::blocks()
 {
     StmtList statements_;
 
+    nesting++;
     while (!check(TokenType::RIGHT_BRACE) && !isAtEnd())
         statements_.push_back(declaration());
+    nesting--;
 
     consume(TokenType::RIGHT_BRACE, "Expect '}' after block.");
 
     return statements_;
 }
 
+void Parser::skipBody()
+{
+    size_t depth = 1;
+    while (!isAtEnd())
+    {
+        TokenType type = advance()->type;
+        if (type == TokenType::LEFT_BRACE)
+            depth++;
+        else if (type == TokenType::RIGHT_BRACE && --depth == 0)
+            return;
+    }
+
+    consume(TokenType::RIGHT_BRACE, "Expect '}' after block.");
+}
+
 ExprPtr Parser::assignment()
 {
     ExprPtr expr = logicOr();
 
     if (match(TokenType::EQUAL))
     {
-        TokenPtr equals = releasePrevious();
+        TokenPtr equals = previous();
         ExprPtr value = assignment();
         if (!value)
             return nullptr;
@@ -230,13 +274,13 @@ ExprPtr Parser::assignment()
         {
         case ExprType::VarExprType:
         {
-            TokenPtr name = static_cast<VarExpr *>(expr.get())->name;
-            expr = std::make_shared<AssignExpr>(name, value);
+            TokenPtr name = static_cast<VarExpr *>(expr)->name;
+            expr = make<AssignExpr>(name, value);
             break;
         }
         default:
+            errorhandler.add(equals->line, equals->lexeme(), "Invalid assignment target.");
             return nullptr;
-            break;
         }
     }
 
@@ -249,11 +293,11 @@ ExprPtr Parser::logicOr()
 
     while (match(TokenType::OR))
     {
-        TokenPtr op = releasePrevious();
+        TokenPtr op = previous();
         ExprPtr right = logicAnd();
         if (!right)
             return nullptr;
-        expr = std::make_shared<LogicExpr>(expr, op, right);
+        expr = make<LogicExpr>(expr, op, right);
     }
     return expr;
 }
@@ -264,11 +308,11 @@ ExprPtr Parser::logicAnd()
 
     while (match(TokenType::AND))
     {
-        TokenPtr op = releasePrevious();
+        TokenPtr op = previous();
         ExprPtr right = equality();
         if (!right)
             return nullptr;
-        expr = std::make_shared<LogicExpr>(expr, op, right);
+        expr = make<LogicExpr>(expr, op, right);
     }
 
     return expr;
@@ -280,9 +324,9 @@ ExprPtr Parser::equality()
 
     while (match(TokenType::BANG_EQUAL, TokenType::EQUAL_EQUAL))
     {
-        TokenPtr opr = releasePrevious();
+        TokenPtr opr = previous();
         ExprPtr right = comparison();
-        expr = std::make_shared<BinaryExpr>(expr, opr, right);
+        expr = make<BinaryExpr>(expr, opr, right);
     }
 
     return expr;
@@ -294,9 +338,9 @@ ExprPtr Parser::comparison()
 
     while (match(TokenType::GREATER, TokenType::GREATER_EQUAL, TokenType::LESS, TokenType::LESS_EQUAL))
     {
-        TokenPtr opr = releasePrevious();
+        TokenPtr opr = previous();
         ExprPtr right = addition();
-        expr = std::make_shared<BinaryExpr>(expr, opr, right);
+        expr = make<BinaryExpr>(expr, opr, right);
     }
 
     return expr;
@@ -308,9 +352,9 @@ ExprPtr Parser::addition()
 
     while (match(TokenType::MINUS, TokenType::PLUS))
     {
-        TokenPtr opr = releasePrevious();
+        TokenPtr opr = previous();
         ExprPtr right = multiplication();
-        expr = std::make_shared<BinaryExpr>(expr, opr, right);
+        expr = make<BinaryExpr>(expr, opr, right);
     }
 
     return expr;
@@ -322,9 +366,9 @@ ExprPtr Parser::multiplication()
 
     while (match(TokenType::SLASH, TokenType::STAR))
     {
-        TokenPtr opr = releasePrevious();
+        TokenPtr opr = previous();
         ExprPtr right = unary();
-        expr = std::make_shared<BinaryExpr>(expr, opr, right);
+        expr = make<BinaryExpr>(expr, opr, right);
     }
 
     return expr;
@@ -334,9 +378,9 @@ ExprPtr Parser::unary()
 {
     if (match(TokenType::BANG, TokenType::MINUS))
     {
-        TokenPtr opr = releasePrevious();
+        TokenPtr opr = previous();
         ExprPtr right = unary();
-        return std::make_shared<UnaryExpr>(opr, right);
+        return make<UnaryExpr>(opr, right);
     }
 
     return call();
@@ -370,7 +414,7 @@ ExprPtr Parser::finishCall(ExprPtr callee)
         do
         {
             if (arguments.size() >= 127)
-                errorhandler.add(peek()->line, peek()->lexeme, "Cannot have more than 127 arguments.");
+                errorhandler.add(peek()->line, peek()->lexeme(), "Cannot have more than 127 arguments.");
 
             ExprPtr expr = expression();
             if (expr)
@@ -382,32 +426,30 @@ ExprPtr Parser::finishCall(ExprPtr callee)
 
     consume(TokenType::RIGHT_PAREN, "Expect ')' after arguments.");
 
-    return std::make_shared<CallExpr>(callee, std::move(arguments));
+    return make<CallExpr>(callee, std::move(arguments));
 }
 
 ExprPtr Parser::primary()
 {
     if (match(TokenType::FALSE))
-        return std::make_shared<BoolLiteralExpr>(false);
+        return make<BoolLiteralExpr>(false);
     if (match(TokenType::TRUE))
-        return std::make_shared<BoolLiteralExpr>(true);
+        return make<BoolLiteralExpr>(true);
     if (match(TokenType::NIL))
-        return std::make_shared<NilLiteralExpr>();
+        return make<NilLiteralExpr>();
 
     if (match(TokenType::NUMBER))
     {
-        double literal = static_cast<NumToken *>(previous())->literal;
-        return std::make_shared<NumLiteralExpr>(literal);
+        return make<NumLiteralExpr>(previous()->literal.number);
     }
     if (match(TokenType::STRING))
     {
-        std::string literal = static_cast<StrToken *>(previous())->literal;
-        return std::make_shared<StrLiteralExpr>(literal);
+        return make<StrLiteralExpr>(previous()->literal.string);
     }
 
     if (match(TokenType::IDENTIFIER))
     {
-        return std::make_shared<VarExpr>(releasePrevious());
+        return make<VarExpr>(previous());
     }
 
     if (match(TokenType::LEFT_PAREN))
@@ -415,9 +457,10 @@ ExprPtr Parser::primary()
         ExprPtr expr = expression();
         if (!consume(TokenType::RIGHT_PAREN, "Expect ')' after expression."))
             return nullptr;
-        return std::make_shared<GroupingExpr>(expr);
+        return make<GroupingExpr>(expr);
     }
 
+    errorhandler.add(peek()->line, isAtEnd() ? " at end" : " at '" + peek()->lexeme() + "'", "Expect expression.");
     return nullptr;
 }
 
@@ -426,19 +469,17 @@ TokenPtr Parser::consume(TokenType type_, const std::string &error_message)
     if (check(type_))
     {
         advance();
-        return releasePrevious();
+        return previous();
     }
 
-    errorhandler.add(peek()->line, peek()->lexeme, error_message);
+    errorhandler.add(peek()->line, peek()->lexeme(), error_message);
     return nullptr;
 }
 
 template <typename... TokenT>
 bool Parser::match(TokenT... types)
 {
-    std::vector<TokenType> typevec = {types...};
-
-    for (TokenType type : typevec)
+    for (TokenType type : {types...})
     {
         if (check(type))
         {
@@ -456,7 +497,7 @@ bool Parser::check(TokenType type)
     return peek()->type == type;
 }
 
-Token *Parser::advance()
+TokenPtr Parser::advance()
 {
     if (!isAtEnd())
         current++;
@@ -468,17 +509,12 @@ bool Parser::isAtEnd()
     return peek()->type == TokenType::END_OF_FILE;
 }
 
-Token *Parser::peek()
+TokenPtr Parser::peek()
 {
-    return tokens[current].get();
+    return &tokens[current];
 }
 
-Token *Parser::previous()
+TokenPtr Parser::previous()
 {
-    return tokens[current - 1].get();
+    return &tokens[current - 1];
 }
-
-TokenPtr Parser::releasePrevious()
-{
-    return tokens[current - 1];
-}
\ No newline at end of file
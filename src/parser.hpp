@@ -1,32 +1,71 @@
 #ifndef PARSER_HPP
 #define PARSER_HPP
 
+#include <memory>
 #include <vector>
 
+#include "arena.hpp"
+#include "source.hpp"
 #include "scanner.hpp"
 #include "ast.hpp"
 
 namespace lox
 {
-    using ExprPtr = std::shared_ptr<Expr>;
-    using StmtPtr = std::shared_ptr<Stmt>;
+    using ExprPtr = Expr *;
+    using StmtPtr = Stmt *;
 
     using ExprList = std::vector<ExprPtr>;
     using StmtList = std::vector<StmtPtr>;
 
-    class Parser
+    /// A parsed program. Every node reachable from `statements` is allocated
+    /// in `arena`, and nodes refer to `tokens`, which in turn point into
+    /// `source`, so the whole tree lives and dies with the Ast. Function
+    /// objects point into it, so it must outlive any closure made from it.
+    struct Ast
     {
-    private:
+        SourceBuffer source;
         TokenList tokens;
+        Arena arena;
         StmtList statements;
+
+        explicit Ast(SourceBuffer &&source_) : source(std::move(source_)) {}
+    };
+
+    using AstPtr = std::unique_ptr<Ast>;
+
+    class Parser
+    {
+    private:
+        AstPtr owned;
+        Ast *ast;
+        const TokenList &tokens;
         size_t current = 0;
 
+        /// With `lazyBodies`, the bodies of top-level functions are only
+        /// checked for balanced braces and left for materialize().
+        bool lazyBodies = false;
+        size_t deferredBodies = 0;
+
+        /// Blocks and function bodies the parser is inside of.
+        size_t nesting = 0;
+
     public:
-        Parser(TokenList &&tokens_, ErrorHandler &error_) : tokens(tokens_), errorhandler(error_) {}
+        /// Parses `ast_->tokens` into `ast_->statements`.
+        Parser(AstPtr ast_, ErrorHandler &error_, bool lazyBodies_ = false)
+            : owned(std::move(ast_)), ast(owned.get()), tokens(ast->tokens), lazyBodies(lazyBodies_), errorhandler(error_) {}
+
+        AstPtr parse();
+
+        /// Function bodies parse() left unparsed.
+        size_t deferred() const { return deferredBodies; }
 
-        StmtList parse();
+        /// Parses the body a lazy parse() skipped, from the tokens and into
+        /// the arena of the Ast it came from.
+        static void materialize(FuncStmt *function, ErrorHandler &error_);
 
     private:
+        Parser(Ast &ast_, ErrorHandler &error_) : ast(&ast_), tokens(ast_.tokens), errorhandler(error_) {}
+
         template <typename... TokenT>
         bool match(TokenT... types);
 
@@ -52,6 +91,9 @@ namespace lox
 
         StmtList blocks();
 
+        /// Skips a function body up to and including its closing brace.
+        void skipBody();
+
         StmtPtr expressionStatement();
 
         ExprPtr assignment();
@@ -78,15 +120,13 @@ namespace lox
 
         bool check(TokenType type);
 
-        Token *advance();
+        TokenPtr advance();
 
         bool isAtEnd();
 
-        Token *peek();
+        TokenPtr peek();
 
-        Token *previous();
-
-        TokenPtr releasePrevious();
+        TokenPtr previous();
 
         ExprPtr expression()
         {
@@ -94,6 +134,18 @@ namespace lox
         }
 
         TokenPtr consume(TokenType type_, const std::string &error_message);
+
+        /// Allocates a node in the program's arena. Nodes built around an
+        /// operator or name take its line; the rest are attributed to the
+        /// last token consumed, and statements to their first token.
+        template <typename T, typename... Args>
+        T *make(Args &&... args)
+        {
+            T *node = ast->arena.make<T>(std::forward<Args>(args)...);
+            if (node->line == 0)
+                node->line = previous()->line;
+            return node;
+        }
     };
 } // namespace lox
 
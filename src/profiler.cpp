@@ -0,0 +1,81 @@
+#include <fstream>
+
+#include <sys/time.h>
+
+#include "profiler.hpp"
+
+using namespace lox;
+
+volatile std::sig_atomic_t Profiler::pending = 0;
+
+static void onTick(int)
+{
+    Profiler::pending = Profiler::pending + 1;
+}
+
+Profiler::~Profiler()
+{
+    stop();
+}
+
+void Profiler::start(long intervalUs)
+{
+    if (running)
+        return;
+
+    struct sigaction action;
+    action.sa_handler = onTick;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGPROF, &action, &previousAction);
+
+    struct itimerval timer;
+    timer.it_interval.tv_sec = intervalUs / 1000000;
+    timer.it_interval.tv_usec = intervalUs % 1000000;
+    timer.it_value = timer.it_interval;
+    setitimer(ITIMER_PROF, &timer, nullptr);
+
+    pending = 0;
+    running = true;
+}
+
+void Profiler::stop()
+{
+    if (!running)
+        return;
+
+    struct itimerval timer = {};
+    setitimer(ITIMER_PROF, &timer, nullptr);
+    sigaction(SIGPROF, &previousAction, nullptr);
+
+    pending = 0;
+    running = false;
+}
+
+void Profiler::record(const std::string &stack)
+{
+    size_t ticks = pending;
+    pending = 0;
+    stacks[stack] += ticks;
+    totalSamples += ticks;
+}
+
+void Profiler::appendFrame(std::string &stack, const std::string &name, size_t line)
+{
+    if (!stack.empty())
+        stack += ';';
+    stack += name;
+    if (line > 0)
+    {
+        stack += ':';
+        stack += std::to_string(line);
+    }
+}
+
+bool Profiler::write(const std::string &path) const
+{
+    std::ofstream file(path);
+    for (auto &stack : stacks)
+        file << stack.first << ' ' << stack.second << '\n';
+    return static_cast<bool>(file);
+}
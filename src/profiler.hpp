@@ -0,0 +1,54 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <csignal>
+#include <map>
+#include <string>
+
+namespace lox
+{
+
+    /// Sampling profiler for Lox code. A SIGPROF interval timer only counts
+    /// ticks in `pending`; the engines check it at safe points (function
+    /// entry and loop back-edges) and hand over their current call stack,
+    /// weighted by the ticks since the last sample. The result is written
+    /// in the folded-stack format flame graph tools read.
+    class Profiler
+    {
+    public:
+        static const long DEFAULT_INTERVAL_US = 1000;
+
+        /// Timer ticks not yet attributed to a stack.
+        static volatile std::sig_atomic_t pending;
+
+        Profiler() {}
+
+        ~Profiler();
+
+        Profiler(const Profiler &) = delete;
+        Profiler &operator=(const Profiler &) = delete;
+
+        void start(long intervalUs = DEFAULT_INTERVAL_US);
+        void stop();
+
+        /// Attributes the pending ticks to `stack`, frames separated by ';'
+        /// and outermost first.
+        void record(const std::string &stack);
+
+        /// Appends one frame to a folded stack: the function name, plus the
+        /// line it was declared on when there is one.
+        static void appendFrame(std::string &stack, const std::string &name, size_t line);
+
+        bool write(const std::string &path) const;
+
+        size_t samples() const { return totalSamples; }
+
+    private:
+        std::map<std::string, size_t> stacks;
+        size_t totalSamples = 0;
+        bool running = false;
+        struct sigaction previousAction;
+    };
+} // namespace lox
+
+#endif
@@ -0,0 +1,230 @@
+#include "resolver.hpp"
+
+using namespace lox;
+
+void Resolver::resolve(StmtList &statements)
+{
+    for (auto &stmt : statements)
+        resolve(stmt);
+}
+
+void Resolver::resolve(Stmt *stmt)
+{
+    if (stmt)
+        stmt->accept(*this);
+}
+
+void Resolver::resolve(Expr *expr)
+{
+    if (expr)
+        expr->accept(*this);
+}
+
+void Resolver::beginScope()
+{
+    scopes.push_back(Scope());
+}
+
+size_t Resolver::endScope()
+{
+    size_t slotCount = scopes.back().size();
+    scopes.pop_back();
+    return slotCount;
+}
+
+int Resolver::declare(const Token *name)
+{
+    if (scopes.empty())
+        return -1;
+
+    Scope &scope = scopes.back();
+    if (scope.find(name->literal.string) != scope.end())
+        errorhandler.add(name->line, " at '" + name->lexeme() + "'", "Variable with this name already declared in this scope.");
+
+    int slot = static_cast<int>(scope.size());
+    scope[name->literal.string] = {slot, false};
+    return slot;
+}
+
+void Resolver::define(const Token *name)
+{
+    if (scopes.empty())
+        return;
+    scopes.back()[name->literal.string].defined = true;
+}
+
+void Resolver::resolveLocal(const Token *name, int &depth, int &slot)
+{
+    for (int i = static_cast<int>(scopes.size()) - 1; i >= 0; i--)
+    {
+        auto it = scopes[i].find(name->literal.string);
+        if (it != scopes[i].end())
+        {
+            depth = static_cast<int>(scopes.size()) - 1 - i;
+            slot = it->second.slot;
+            return;
+        }
+    }
+
+    depth = -1;
+    slot = -1;
+}
+
+void Resolver::resolveFunction(FuncStmt *stmt)
+{
+    FunctionType enclosingFunction = currentFunction;
+    currentFunction = FunctionType::Function;
+    size_t functionsBefore = ++functionCount;
+
+    beginScope();
+    for (auto &param : stmt->params)
+    {
+        declare(param);
+        define(param);
+    }
+    resolve(stmt->body);
+    stmt->slotCount = endScope();
+    stmt->captured = functionCount != functionsBefore;
+
+    currentFunction = enclosingFunction;
+}
+
+bool Resolver::declaresVariables(const StmtList &statements)
+{
+    for (auto &stmt : statements)
+    {
+        if (stmt->type == StmtType::VarStmtType || stmt->type == StmtType::FuncStmtType)
+            return true;
+    }
+    return false;
+}
+
+void Resolver::visit(BlockStmt *stmt)
+{
+    size_t functionsBefore = functionCount;
+
+    if (declaresVariables(stmt->statements))
+    {
+        beginScope();
+        resolve(stmt->statements);
+        stmt->slotCount = endScope();
+    }
+    else
+    {
+        resolve(stmt->statements);
+        stmt->slotCount = 0;
+    }
+
+    stmt->captured = functionCount != functionsBefore;
+}
+
+void Resolver::visit(ExprStmt *stmt)
+{
+    resolve(stmt->expression);
+}
+
+void Resolver::visit(FuncStmt *stmt)
+{
+    stmt->slot = declare(stmt->name);
+    define(stmt->name);
+    resolveFunction(stmt);
+}
+
+void Resolver::visit(IfStmt *stmt)
+{
+    resolve(stmt->condition);
+    resolve(stmt->thenBranch);
+    resolve(stmt->elseBranch);
+}
+
+void Resolver::visit(PrintStmt *stmt)
+{
+    resolve(stmt->expression);
+}
+
+void Resolver::visit(ReturnStmt *stmt)
+{
+    if (currentFunction == FunctionType::None)
+        errorhandler.add(stmt->keyword->line, " at 'return'", "Cannot return from top-level code.");
+    resolve(stmt->value);
+}
+
+void Resolver::visit(VarStmt *stmt)
+{
+    stmt->slot = declare(stmt->name);
+    resolve(stmt->initializer);
+    define(stmt->name);
+}
+
+void Resolver::visit(WhileStmt *stmt)
+{
+    resolve(stmt->condition);
+    resolve(stmt->body);
+    resolve(stmt->increment);
+}
+
+void Resolver::visit(AssignExpr *expr)
+{
+    resolve(expr->value);
+    resolveLocal(expr->name, expr->depth, expr->slot);
+}
+
+void Resolver::visit(BinaryExpr *expr)
+{
+    resolve(expr->left);
+    resolve(expr->right);
+}
+
+void Resolver::visit(CallExpr *expr)
+{
+    resolve(expr->callee);
+    for (auto &arg : expr->arguments)
+        resolve(arg);
+}
+
+void Resolver::visit(GroupingExpr *expr)
+{
+    resolve(expr->expression);
+}
+
+void Resolver::visit(NilLiteralExpr *) {}
+
+void Resolver::visit(BoolLiteralExpr *) {}
+
+void Resolver::visit(StrLiteralExpr *) {}
+
+void Resolver::visit(NumLiteralExpr *) {}
+
+void Resolver::visit(LogicExpr *expr)
+{
+    resolve(expr->left);
+    resolve(expr->right);
+}
+
+void Resolver::visit(UnaryExpr *expr)
+{
+    resolve(expr->right);
+}
+
+void Resolver::visit(VarExpr *expr)
+{
+    if (!scopes.empty())
+    {
+        auto it = scopes.back().find(expr->name->literal.string);
+        if (it != scopes.back().end() && !it->second.defined)
+            errorhandler.add(expr->name->line, " at '" + expr->name->lexeme() + "'", "Cannot read local variable in its own initializer.");
+    }
+
+    resolveLocal(expr->name, expr->depth, expr->slot);
+}
+
+void Resolver::visit(AddAssignExpr *expr)
+{
+    resolve(expr->operand);
+    resolveLocal(expr->name, expr->depth, expr->slot);
+}
+
+void Resolver::visit(CompareConstExpr *expr)
+{
+    resolveLocal(expr->name, expr->depth, expr->slot);
+}
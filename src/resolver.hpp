@@ -0,0 +1,93 @@
+#ifndef RESOLVER_HPP
+#define RESOLVER_HPP
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ast.hpp"
+#include "parser.hpp"
+#include "error_handler.hpp"
+
+namespace lox
+{
+
+    /// Static pass run between parsing and interpretation. Every local
+    /// variable gets a slot in its scope, and every VarExpr/AssignExpr is
+    /// annotated with how many scopes to hop and which slot to read.
+    ///
+    /// Blocks that declare nothing get no scope, so the interpreter can run
+    /// them in the enclosing Env.
+    class Resolver : public ExprVisitor, StmtVisitor
+    {
+    public:
+        Resolver(ErrorHandler &errorhandler_) : errorhandler(errorhandler_) {}
+
+        void resolve(StmtList &statements);
+
+        /// Resolves the body of a top-level function parsed after the rest
+        /// of the program.
+        void resolve(FuncStmt *function) { resolveFunction(function); }
+
+    private:
+        enum class FunctionType
+        {
+            None,
+            Function,
+        };
+
+        struct Local
+        {
+            int slot;
+            bool defined;
+        };
+
+        using Scope = std::unordered_map<StrObj *, Local>;
+
+        ErrorHandler &errorhandler;
+        std::vector<Scope> scopes;
+        FunctionType currentFunction = FunctionType::None;
+
+        /// FuncStmts resolved so far, to tell whether a block contains one.
+        size_t functionCount = 0;
+
+        void resolve(Stmt *stmt);
+        void resolve(Expr *expr);
+        void resolveFunction(FuncStmt *stmt);
+        void resolveLocal(const Token *name, int &depth, int &slot);
+
+        void beginScope();
+        size_t endScope();
+        int declare(const Token *name);
+        void define(const Token *name);
+
+        static bool declaresVariables(const StmtList &statements);
+
+        /// Expressions.
+        void visit(AssignExpr *expr) override;
+        void visit(BinaryExpr *expr) override;
+        void visit(CallExpr *expr) override;
+        void visit(GroupingExpr *expr) override;
+        void visit(NilLiteralExpr *expr) override;
+        void visit(BoolLiteralExpr *expr) override;
+        void visit(StrLiteralExpr *expr) override;
+        void visit(NumLiteralExpr *expr) override;
+        void visit(LogicExpr *expr) override;
+        void visit(UnaryExpr *expr) override;
+        void visit(VarExpr *expr) override;
+        void visit(AddAssignExpr *expr) override;
+        void visit(CompareConstExpr *expr) override;
+
+        /// Statements.
+        void visit(BlockStmt *stmt) override;
+        void visit(ExprStmt *stmt) override;
+        void visit(FuncStmt *stmt) override;
+        void visit(IfStmt *stmt) override;
+        void visit(PrintStmt *stmt) override;
+        void visit(ReturnStmt *stmt) override;
+        void visit(VarStmt *stmt) override;
+        void visit(WhileStmt *stmt) override;
+    };
+} // namespace lox
+
+#endif
@@ -0,0 +1,117 @@
+#include <iostream>
+
+#include "cache.hpp"
+#include "runtime.hpp"
+#include "scanner.hpp"
+#include "resolver.hpp"
+#include "optimizer.hpp"
+#include "compiler.hpp"
+#include "error_handler.hpp"
+
+using namespace lox;
+
+static bool interpret(const Program &program, Runtime &runtime)
+{
+    try
+    {
+        if (program.script)
+            runtime.vm.interpret(program.script);
+        else
+            runtime.interpreter.interpret(*program.statements);
+    }
+    catch (RuntimeError &error)
+    {
+        std::cerr << "[line " << error.line << "] Runtime error: " << error.what() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+Program lox::compile(SourceBuffer &&source, Runtime &runtime, const std::string &cachePath)
+{
+    ErrorHandler errors;
+
+    // The Ast owns the source so tokens can point straight into it.
+    AstPtr ast(new Ast(std::move(source)));
+    if (cachePath.empty() || !AstCache::load(cachePath, *ast, runtime.heap))
+    {
+        Scanner scanner(ast->source, runtime.heap, errors);
+        ast->tokens = scanner.scanTokens();
+
+        Parser parser(std::move(ast), errors, runtime.lazyParse && cachePath.empty());
+        ast = parser.parse();
+        runtime.lazyBodies.deferred += parser.deferred();
+        if (!cachePath.empty() && !errors.hasError())
+            AstCache::save(cachePath, *ast);
+    }
+
+    Ast &tree = *ast;
+    StmtList &stmts = ast->statements;
+    runtime.programs.push_back(std::move(ast));
+    if (errors.hasError())
+    {
+        errors.report();
+        return Program();
+    }
+
+    Resolver resolver(errors);
+    resolver.resolve(stmts);
+    if (errors.hasError())
+    {
+        errors.report();
+        return Program();
+    }
+
+    if (runtime.optimize)
+    {
+        Optimizer optimizer(tree, runtime.heap, runtime.engine == Engine::Tree);
+        optimizer.optimize(stmts);
+        runtime.nodesEliminated += optimizer.eliminated();
+    }
+
+    Program program;
+    program.statements = &stmts;
+    if (runtime.engine == Engine::VM)
+    {
+        Compiler compiler(runtime.vm.functions, runtime.heap, errors);
+        program.script = compiler.compile(stmts);
+        if (errors.hasError())
+        {
+            errors.report();
+            return Program();
+        }
+    }
+    return program;
+}
+
+bool lox::execute(const Program &program, Runtime &runtime, const Bindings &bindings)
+{
+    if (!program)
+        return false;
+
+    bool vm = runtime.engine == Engine::VM;
+    if (vm)
+        runtime.vm.resetGlobals();
+    else
+        runtime.interpreter.resetGlobals();
+
+    // Each value is defined as soon as it exists, so an allocation for the
+    // next one cannot collect it. Names are pinned: they recur every record.
+    for (auto &entry : bindings.entries)
+    {
+        StrObj *name = runtime.heap.internPinned(entry.name.data(), entry.name.size());
+        Value value = entry.isString ? Value(runtime.heap.intern(entry.string)) : entry.value;
+        if (vm)
+            runtime.vm.defineGlobal(name, value);
+        else
+            runtime.interpreter.defineGlobal(name, value);
+    }
+
+    return interpret(program, runtime);
+}
+
+bool lox::run(SourceBuffer &&source, Runtime &runtime, const std::string &cachePath)
+{
+    Program program = compile(std::move(source), runtime, cachePath);
+    return program && interpret(program, runtime);
+}
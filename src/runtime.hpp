@@ -0,0 +1,216 @@
+#ifndef RUNTIME_HPP
+#define RUNTIME_HPP
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "heap.hpp"
+#include "hotspots.hpp"
+#include "interpreter.hpp"
+#include "lazy.hpp"
+#include "parser.hpp"
+#include "profiler.hpp"
+#include "source.hpp"
+#include "vm.hpp"
+
+namespace lox
+{
+
+    enum class Engine
+    {
+        Tree,
+        VM,
+    };
+
+    struct Options
+    {
+        Engine engine = Engine::Tree;
+        std::string path;
+        bool gcStats = false;
+        size_t gcThreshold = Heap::DEFAULT_THRESHOLD;
+        double gcGrowth = 2.0;
+
+        /// Where --profile writes folded stacks; empty when not profiling.
+        std::string profilePath;
+
+        bool hotspots = false;
+        bool icStats = false;
+        bool optimize = true;
+        bool optStats = false;
+
+        /// Under --cache, the parsed tree of a script file is cached in
+        /// `cacheDir`, or next to the script when that is empty.
+        bool cache = false;
+        std::string cacheDir;
+
+        /// Deepest the Lox call stack may get; set by --max-depth.
+        size_t maxDepth = DEFAULT_MAX_DEPTH;
+
+        /// Parse top-level function bodies on their first call. Only the
+        /// tree-walker supports it, and not together with --cache.
+        bool lazyParse = false;
+    };
+
+    /// Holds the heap and whichever execution engine was selected, so REPL
+    /// lines share globals across calls to run().
+    struct Runtime
+    {
+        Engine engine;
+        bool gcStats;
+        std::string profilePath;
+        Profiler profiler;
+        bool hotspotsEnabled;
+        Hotspots hotspots;
+        bool icStats;
+        bool optimize;
+        bool optStats;
+        bool lazyParse;
+
+        /// AST nodes removed by the optimizer across every run().
+        size_t nodesEliminated = 0;
+        Heap heap;
+        LazyBodies lazyBodies;
+        Interpreter interpreter;
+        VM vm;
+
+        /// Every tree parsed so far. Functions defined on one REPL line are
+        /// called from later ones, so their declarations must stay alive.
+        std::vector<AstPtr> programs;
+
+        Runtime(const Options &options)
+            : engine(options.engine),
+              gcStats(options.gcStats),
+              profilePath(options.profilePath),
+              hotspotsEnabled(options.hotspots),
+              icStats(options.icStats),
+              optimize(options.optimize),
+              optStats(options.optStats),
+              lazyParse(options.lazyParse && options.engine == Engine::Tree),
+              heap(options.gcThreshold, options.gcGrowth),
+              lazyBodies(heap, options.optimize),
+              interpreter(heap),
+              vm(heap)
+        {
+            if (!profilePath.empty())
+            {
+                interpreter.profiler = &profiler;
+                vm.profiler = &profiler;
+                profiler.start();
+            }
+            if (hotspotsEnabled)
+                interpreter.hotspots = &hotspots;
+            interpreter.maxDepth = options.maxDepth;
+            vm.maxDepth = options.maxDepth;
+            if (lazyParse)
+                interpreter.lazyBodies = &lazyBodies;
+            if (icStats)
+            {
+                interpreter.countCacheHits = true;
+                vm.countCacheHits = true;
+            }
+        }
+
+        ~Runtime()
+        {
+            if (!profilePath.empty())
+            {
+                profiler.stop();
+                if (profiler.write(profilePath))
+                    std::cerr << "[profile] " << profiler.samples() << " samples written to " << profilePath << std::endl;
+                else
+                    std::cerr << "[profile] could not write " << profilePath << std::endl;
+            }
+            if (hotspotsEnabled)
+            {
+                if (engine == Engine::Tree)
+                    hotspots.print(std::cerr);
+                else
+                    std::cerr << "[hotspots] only collected by the tree-walking interpreter" << std::endl;
+            }
+            if (optStats)
+            {
+                std::cerr << "[opt] " << nodesEliminated + lazyBodies.nodesEliminated << " AST nodes eliminated" << std::endl;
+                if (lazyParse)
+                    std::cerr << "[opt] " << lazyBodies.deferred - lazyBodies.materialized << " of " << lazyBodies.deferred
+                              << " lazily parsed function bodies never materialized" << std::endl;
+            }
+            if (icStats)
+                printCacheStats();
+            if (gcStats)
+                heap.printStats();
+        }
+
+        void printCacheStats() const
+        {
+            bool tree = engine == Engine::Tree;
+            printCacheStats("global reads: ", tree ? interpreter.globalReads : vm.globalReads);
+            printCacheStats("global writes:", tree ? interpreter.globalWrites : vm.globalWrites);
+        }
+
+        static void printCacheStats(const char *label, const CacheStats &stats)
+        {
+            size_t total = stats.hits + stats.misses;
+            std::cerr << "[ic] " << label << " " << stats.hits << " hits, " << stats.misses << " misses";
+            if (total > 0)
+                std::cerr << " (" << 100.0 * stats.hits / total << "% hit rate)";
+            std::cerr << std::endl;
+        }
+    };
+
+    /// A script scanned, parsed, resolved and optimized once by compile(),
+    /// then run any number of times by execute(). Its tree is kept alive by
+    /// the Runtime that compiled it, and it only runs there. Empty when the
+    /// script had compile errors.
+    struct Program
+    {
+        StmtList *statements = nullptr;
+
+        /// The compiled script when the Runtime uses the VM.
+        FunctionProto *script = nullptr;
+
+        explicit operator bool() const { return statements != nullptr; }
+    };
+
+    /// Globals defined for one execute(), such as the fields of an input
+    /// record. Strings are only interned when the program runs, so building
+    /// a Bindings never touches the heap.
+    struct Bindings
+    {
+        struct Entry
+        {
+            std::string name;
+            Value value;
+            std::string string;
+            bool isString;
+        };
+
+        std::vector<Entry> entries;
+
+        void set(const std::string &name, double number) { entries.push_back({name, Value(number), std::string(), false}); }
+        void set(const std::string &name, int number) { set(name, static_cast<double>(number)); }
+        void set(const std::string &name, bool boolean) { entries.push_back({name, Value(boolean), std::string(), false}); }
+        void set(const std::string &name, const std::string &string) { entries.push_back({name, Value(), string, true}); }
+        void set(const std::string &name, const char *string) { set(name, std::string(string)); }
+        void setNil(const std::string &name) { entries.push_back({name, Value(), std::string(), false}); }
+    };
+
+    /// Scans, parses, resolves and optimizes one script, and compiles it
+    /// when the Runtime uses the VM, without running it. Compile errors are
+    /// reported to stderr and give an empty Program.
+    ///
+    /// With a `cachePath`, the parsed tree is loaded from that AstCache file
+    /// when it matches the source, and saved there otherwise.
+    Program compile(SourceBuffer &&source, Runtime &runtime, const std::string &cachePath = std::string());
+
+    /// Runs a Program against fresh globals holding only the natives and
+    /// `bindings`. Returns false after reporting a runtime error to stderr.
+    bool execute(const Program &program, Runtime &runtime, const Bindings &bindings = Bindings());
+
+    /// Compiles and executes one script. Globals persist across calls, as
+    /// the REPL needs. Returns false after reporting a compile or runtime
+    /// error to stderr.
+    bool run(SourceBuffer &&source, Runtime &runtime, const std::string &cachePath = std::string());
+} // namespace lox
+
+#endif
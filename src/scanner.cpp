@@ -1,28 +1,17 @@
+#include <cstdlib>
+#include <cstring>
+
 #include "scanner.hpp"
 #include "error_handler.hpp"
+#include "heap.hpp"
 
 using namespace lox;
 
-Scanner::Scanner(const std::string &source_, ErrorHandler &handler_)
-    : source(source_), errorhandler(handler_)
+Scanner::Scanner(const SourceBuffer &source_, Heap &heap_, ErrorHandler &handler_)
+    : source(source_.data()), length(source_.size()), heap(heap_), errorhandler(handler_)
 {
-
-    keywords["and"] = TokenType::AND;
-    keywords["class"] = TokenType::CLASS;
-    keywords["else"] = TokenType::ELSE;
-    keywords["false"] = TokenType::FALSE;
-    keywords["for"] = TokenType::FOR;
-    keywords["fun"] = TokenType::FUN;
-    keywords["if"] = TokenType::IF;
-    keywords["nil"] = TokenType::NIL;
-    keywords["or"] = TokenType::OR;
-    keywords["print"] = TokenType::PRINT;
-    keywords["return"] = TokenType::RETURN;
-    keywords["super"] = TokenType::SUPER;
-    keywords["this"] = TokenType::THIS;
-    keywords["true"] = TokenType::TRUE;
-    keywords["var"] = TokenType::VAR;
-    keywords["while"] = TokenType::WHILE;
+    // Roughly one token per five characters of typical source.
+    tokens.reserve(length / 5 + 1);
 }
 
 TokenList Scanner::scanTokens()
@@ -33,13 +22,14 @@ TokenList Scanner::scanTokens()
         scanToken();
     }
 
-    tokens.push_back(std::make_shared<Token>(TokenType::END_OF_FILE, "", line));
-    return tokens;
+    start = current;
+    addToken(TokenType::END_OF_FILE);
+    return std::move(tokens);
 }
 
 bool Scanner::isAtEnd()
 {
-    return current >= source.size();
+    return current >= length;
 }
 
 void Scanner::scanToken()
@@ -158,7 +148,7 @@ char Scanner::peek()
 
 char Scanner::peekNext()
 {
-    if (current + 1 >= source.size())
+    if (current + 1 >= length)
         return '\0';
     return source[current + 1];
 }
@@ -168,15 +158,11 @@ char Scanner::advance()
     return source[current++];
 }
 
-void Scanner::addToken(TokenType type)
-{
-    addToken(type, "");
-}
-
-void Scanner::addToken(TokenType type, const std::string &literal)
+Token &Scanner::addToken(TokenType type)
 {
-    const std::string text = source.substr(start, current - start);
-    tokens.push_back(std::make_shared<Token>(type, text, line));
+    tokens.emplace_back(type, source + start,
+                        static_cast<uint32_t>(current - start), static_cast<uint32_t>(line));
+    return tokens.back();
 }
 
 void Scanner::getString()
@@ -195,14 +181,7 @@ void Scanner::getString()
     }
 
     advance();
-    const std::string literal = source.substr(start + 1, current - start - 2);
-    addStrToken(literal);
-}
-
-void Scanner::addStrToken(const std::string &literal)
-{
-    const std::string text = source.substr(start, current - start);
-    tokens.push_back(std::make_shared<StrToken>(text, literal, line));
+    addToken(TokenType::STRING).literal.string = heap.internPinned(source + start + 1, current - start - 2);
 }
 
 bool Scanner::isDigit(const char &c)
@@ -220,14 +199,21 @@ void Scanner::getNum()
     while (isDigit(peek()))
         advance();
 
-    const std::string literal = source.substr(start, current - start);
-    addNumToken(literal);
-}
+    // strtod needs a terminated string, and the buffer may not have one
+    // right after the number. Any real literal fits on the stack.
+    char digits[64];
+    size_t count = current - start;
+    double value;
+    if (count < sizeof(digits))
+    {
+        std::memcpy(digits, source + start, count);
+        digits[count] = '\0';
+        value = std::strtod(digits, nullptr);
+    }
+    else
+        value = std::strtod(std::string(source + start, count).c_str(), nullptr);
 
-void Scanner::addNumToken(const std::string &literal)
-{
-    const std::string text = source.substr(start, current - start);
-    tokens.push_back(std::make_shared<NumToken>(text, std::stod(literal), line));
+    addToken(TokenType::NUMBER).literal.number = value;
 }
 
 bool Scanner::isAlpha(const char &c)
@@ -242,10 +228,75 @@ void Scanner::identifer()
     while (isAlpha(peek()) || isDigit(peek()))
         advance();
 
-    std::string text = source.substr(start, current - start);
-    auto it = keywords.find(text);
-    if (it != keywords.end())
-        addToken(it->second);
+    TokenType type = identifierType();
+    if (type == TokenType::IDENTIFIER)
+        addToken(type).literal.string = heap.internPinned(source + start, current - start);
     else
-        addToken(TokenType::IDENTIFIER);
-}
\ No newline at end of file
+        addToken(type);
+}
+
+TokenType Scanner::identifierType()
+{
+    switch (source[start])
+    {
+    case 'a':
+        return checkKeyword(1, "nd", TokenType::AND);
+    case 'c':
+        return checkKeyword(1, "lass", TokenType::CLASS);
+    case 'e':
+        return checkKeyword(1, "lse", TokenType::ELSE);
+    case 'f':
+        if (current - start > 1)
+        {
+            switch (source[start + 1])
+            {
+            case 'a':
+                return checkKeyword(2, "lse", TokenType::FALSE);
+            case 'o':
+                return checkKeyword(2, "r", TokenType::FOR);
+            case 'u':
+                return checkKeyword(2, "n", TokenType::FUN);
+            }
+        }
+        break;
+    case 'i':
+        return checkKeyword(1, "f", TokenType::IF);
+    case 'n':
+        return checkKeyword(1, "il", TokenType::NIL);
+    case 'o':
+        return checkKeyword(1, "r", TokenType::OR);
+    case 'p':
+        return checkKeyword(1, "rint", TokenType::PRINT);
+    case 'r':
+        return checkKeyword(1, "eturn", TokenType::RETURN);
+    case 's':
+        return checkKeyword(1, "uper", TokenType::SUPER);
+    case 't':
+        if (current - start > 1)
+        {
+            switch (source[start + 1])
+            {
+            case 'h':
+                return checkKeyword(2, "is", TokenType::THIS);
+            case 'r':
+                return checkKeyword(2, "ue", TokenType::TRUE);
+            }
+        }
+        break;
+    case 'v':
+        return checkKeyword(1, "ar", TokenType::VAR);
+    case 'w':
+        return checkKeyword(1, "hile", TokenType::WHILE);
+    }
+
+    return TokenType::IDENTIFIER;
+}
+
+TokenType Scanner::checkKeyword(size_t offset, const char *rest, TokenType type)
+{
+    size_t restLength = std::strlen(rest);
+    if (current - start == offset + restLength &&
+        std::memcmp(source + start + offset, rest, restLength) == 0)
+        return type;
+    return TokenType::IDENTIFIER;
+}
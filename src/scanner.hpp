@@ -1,16 +1,19 @@
 #ifndef SCANNER_HPP
 #define SCANNER_HPP
 
+#include <cstdint>
 #include <string>
 #include <vector>
-#include <memory>
-#include <unordered_map>
 
 #include "error_handler.hpp"
+#include "source.hpp"
 
 namespace lox
 {
 
+    class Heap;
+    class StrObj;
+
     /***************************************************/
     // Token
 
@@ -152,73 +155,65 @@ namespace lox
         }
     }
 
+    /// A lexeme in the scanned source. Tokens are plain values that point
+    /// into the source buffer rather than copying out of it, so the buffer
+    /// must outlive every token taken from it.
     class Token
     {
         friend const std::string tokentype_to_string(const TokenType &type);
 
     public:
         TokenType type;
-        std::string lexeme;
-        size_t line;
-
-        Token(const TokenType type_, const std::string &lexeme_, const size_t line_)
-            : type(type_), lexeme(lexeme_), line(line_) {}
+        uint32_t line;
+        uint32_t length;
+        const char *start;
 
-        virtual std::string toString() const
+        /// NUMBER: the parsed value. STRING: the interned contents.
+        /// IDENTIFIER: the interned name. Unused for every other token.
+        union
         {
-            return "Type: " + tokentype_to_string(type) + ", lexeme: " + lexeme + ";";
-        }
-    };
-
-    class StrToken : public Token
-    {
-    public:
-        std::string literal;
+            double number;
+            StrObj *string;
+        } literal;
 
-        StrToken(const std::string &lexeme_, const std::string &literal_, const size_t line_)
-            : Token(TokenType::STRING, lexeme_, line_), literal(literal_) {}
-
-        std::string toString() const override
+        Token(TokenType type_, const char *start_, uint32_t length_, uint32_t line_)
+            : type(type_), line(line_), length(length_), start(start_)
         {
-            return "Type: " + tokentype_to_string(TokenType::STRING) + ", literal: " + literal + ";";
+            literal.string = nullptr;
         }
-    };
-
-    class NumToken : public Token
-    {
-    public:
-        double literal;
 
-        NumToken(const std::string &lexeme_, const double literal_, const size_t line_)
-            : Token(TokenType::NUMBER, lexeme_, line_), literal(literal_) {}
+        std::string lexeme() const { return std::string(start, length); }
 
-        std::string toString() const override
+        std::string toString() const
         {
-            return "Type: " + tokentype_to_string(TokenType::NUMBER) + ", literal: " + std::to_string(literal) + ";";
+            if (type == TokenType::NUMBER)
+                return "Type: " + tokentype_to_string(type) + ", literal: " + std::to_string(literal.number) + ";";
+            return "Type: " + tokentype_to_string(type) + ", lexeme: " + lexeme() + ";";
         }
     };
 
     /***************************************************/
     // Scanner
 
-    using TokenPtr = std::shared_ptr<Token>;
-    using TokenList = std::vector<TokenPtr>;
+    using TokenList = std::vector<Token>;
 
+    /// Splits a source buffer into tokens. The scanner reads the buffer in
+    /// place; the returned tokens point into it.
     class Scanner
     {
     public:
-        Scanner(const std::string &source_, ErrorHandler &handler_);
+        Scanner(const SourceBuffer &source_, Heap &heap_, ErrorHandler &handler_);
         TokenList scanTokens();
 
     private:
-        std::unordered_map<std::string, TokenType> keywords;
-
-        std::string source;
+        const char *source;
+        size_t length;
         TokenList tokens;
         size_t start = 0;
         size_t current = 0;
         size_t line = 1;
 
+        Heap &heap;
         ErrorHandler &errorhandler;
 
         bool isAtEnd();
@@ -234,11 +229,10 @@ namespace lox
         bool isAlpha(const char &c);
         bool isAlphaNumeric(const char &c);
         void identifer();
+        TokenType identifierType();
+        TokenType checkKeyword(size_t offset, const char *rest, TokenType type);
 
-        void addToken(TokenType type);
-        void addNumToken(const std::string &literal);
-        void addStrToken(const std::string &literal);
-        void addToken(TokenType type, const std::string &literal);
+        Token &addToken(TokenType type);
     };
 } // namespace lox
 #endif
\ No newline at end of file
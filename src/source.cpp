@@ -0,0 +1,86 @@
+#include <cerrno>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "source.hpp"
+
+using namespace lox;
+
+SourceBuffer::~SourceBuffer()
+{
+    unmap();
+}
+
+SourceBuffer::SourceBuffer(SourceBuffer &&other)
+    : mapping(other.mapping), mappedSize(other.mappedSize), text(std::move(other.text))
+{
+    other.mapping = nullptr;
+    other.mappedSize = 0;
+}
+
+SourceBuffer &SourceBuffer::operator=(SourceBuffer &&other)
+{
+    if (this != &other)
+    {
+        unmap();
+        mapping = other.mapping;
+        mappedSize = other.mappedSize;
+        text = std::move(other.text);
+        other.mapping = nullptr;
+        other.mappedSize = 0;
+    }
+    return *this;
+}
+
+void SourceBuffer::unmap()
+{
+    if (mapping)
+        munmap(const_cast<char *>(mapping), mappedSize);
+    mapping = nullptr;
+    mappedSize = 0;
+}
+
+bool SourceBuffer::open(const std::string &path)
+{
+    unmap();
+    text.clear();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0)
+    {
+        void *memory = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (memory != MAP_FAILED)
+        {
+            madvise(memory, info.st_size, MADV_SEQUENTIAL);
+            mapping = static_cast<const char *>(memory);
+            mappedSize = info.st_size;
+            close(fd);
+            return true;
+        }
+    }
+
+    // Not mappable: read it in chunks, e.g. from a pipe.
+    char chunk[64 * 1024];
+    ssize_t count;
+    while ((count = read(fd, chunk, sizeof(chunk))) != 0)
+    {
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count < 0)
+        {
+            close(fd);
+            return false;
+        }
+        text.append(chunk, count);
+    }
+
+    close(fd);
+    return true;
+}
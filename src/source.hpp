@@ -0,0 +1,48 @@
+#ifndef SOURCE_HPP
+#define SOURCE_HPP
+
+#include <cstddef>
+#include <string>
+
+namespace lox
+{
+
+    /// The text of one script, which the scanner reads in place. Regular
+    /// files are mapped read-only instead of being copied into memory;
+    /// anything that cannot be mapped (pipes, terminals, empty files) and
+    /// REPL input is held in an owned string instead.
+    class SourceBuffer
+    {
+    public:
+        SourceBuffer() {}
+
+        explicit SourceBuffer(std::string &&text_) : text(std::move(text_)) {}
+
+        ~SourceBuffer();
+
+        SourceBuffer(SourceBuffer &&other);
+        SourceBuffer &operator=(SourceBuffer &&other);
+
+        SourceBuffer(const SourceBuffer &) = delete;
+        SourceBuffer &operator=(const SourceBuffer &) = delete;
+
+        /// Loads `path`, mapping it if possible. Returns false if the file
+        /// cannot be opened or read.
+        bool open(const std::string &path);
+
+        const char *data() const { return mapping ? mapping : text.data(); }
+        size_t size() const { return mapping ? mappedSize : text.size(); }
+        char operator[](size_t index) const { return data()[index]; }
+
+        bool isMapped() const { return mapping != nullptr; }
+
+    private:
+        const char *mapping = nullptr;
+        size_t mappedSize = 0;
+        std::string text;
+
+        void unmap();
+    };
+} // namespace lox
+
+#endif
@@ -0,0 +1,159 @@
+#include "stack.hpp"
+
+#ifdef LOX_NATIVE_STACK
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cstdint>
+
+#if defined(__SANITIZE_ADDRESS__)
+#define LOX_ASAN 1
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define LOX_ASAN 1
+#endif
+#endif
+
+#ifdef LOX_ASAN
+#include <dlfcn.h>
+#include <sanitizer/common_interface_defs.h>
+#endif
+
+using namespace lox;
+
+namespace
+{
+    // AddressSanitizer has to be told about every switch between stacks,
+    // or it mistakes one for the other when an exception is thrown.
+    void startSwitch(void **fakeStack, const void *bottom, size_t size)
+    {
+#ifdef LOX_ASAN
+        __sanitizer_start_switch_fiber(fakeStack, bottom, size);
+#else
+        (void)fakeStack, (void)bottom, (void)size;
+#endif
+    }
+
+    void finishSwitch(void *fakeStack, const void **bottom, size_t *size)
+    {
+#ifdef LOX_ASAN
+        __sanitizer_finish_switch_fiber(fakeStack, bottom, size);
+#else
+        (void)fakeStack, (void)bottom, (void)size;
+#endif
+    }
+
+    // AddressSanitizer intercepts swapcontext() and warns on the first call
+    // that it cannot follow the switch, which would end up in every run's
+    // output. The annotations above already tell it about the switch, so
+    // libc's swapcontext() is called directly.
+    int switchTo(ucontext_t *from, ucontext_t *to)
+    {
+#ifdef LOX_ASAN
+        typedef int (*Swap)(ucontext_t *, const ucontext_t *);
+        static Swap swap = []() -> Swap {
+            void *libc = dlopen("libc.so.6", RTLD_LAZY | RTLD_NOLOAD);
+            void *symbol = libc ? dlsym(libc, "swapcontext") : nullptr;
+            return symbol ? reinterpret_cast<Swap>(symbol) : swapcontext;
+        }();
+        return swap(from, to);
+#else
+        return swapcontext(from, to);
+#endif
+    }
+} // namespace
+
+NativeStack::~NativeStack()
+{
+    if (memory)
+        munmap(memory, reserved);
+}
+
+bool NativeStack::reserve(size_t bytes)
+{
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    bytes = (bytes + page - 1) / page * page + page;
+
+    void *mapped = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mapped == MAP_FAILED)
+        return false;
+
+    // The lowest page is a guard, so running off the end faults instead of
+    // writing over whatever lies below.
+    mprotect(mapped, page, PROT_NONE);
+
+    if (memory)
+        munmap(memory, reserved);
+    memory = static_cast<char *>(mapped);
+    reserved = bytes;
+
+    // Only the entry point has to be set up again for each run.
+    getcontext(&context);
+    context.uc_stack.ss_sp = memory;
+    context.uc_stack.ss_size = reserved;
+    context.uc_link = &caller;
+    return true;
+}
+
+bool NativeStack::run(size_t bytes, const std::function<void()> &body_)
+{
+    if (bytes > reserved && !reserve(bytes))
+        return false;
+
+    uint64_t self = reinterpret_cast<uintptr_t>(this);
+    makecontext(&context, reinterpret_cast<void (*)()>(enter), 2,
+                static_cast<unsigned>(self >> 32), static_cast<unsigned>(self));
+
+    body = &body_;
+    error = nullptr;
+    void *fakeStack = nullptr;
+    startSwitch(&fakeStack, memory, reserved);
+    switchTo(&caller, &context);
+    finishSwitch(fakeStack, nullptr, nullptr);
+    body = nullptr;
+
+    if (error)
+    {
+        std::exception_ptr thrown = error;
+        error = nullptr;
+        std::rethrow_exception(thrown);
+    }
+    return true;
+}
+
+void NativeStack::enter(unsigned high, unsigned low)
+{
+    uint64_t self = (static_cast<uint64_t>(high) << 32) | low;
+    NativeStack *stack = reinterpret_cast<NativeStack *>(static_cast<uintptr_t>(self));
+    finishSwitch(nullptr, &stack->callerBottom, &stack->callerSize);
+
+    // Exceptions cannot unwind past the start of the stack, so they are
+    // carried back to run() instead.
+    try
+    {
+        (*stack->body)();
+    }
+    catch (...)
+    {
+        stack->error = std::current_exception();
+    }
+
+    // Returning resumes run() through uc_link.
+    startSwitch(nullptr, stack->callerBottom, stack->callerSize);
+}
+
+#else
+
+using namespace lox;
+
+NativeStack::~NativeStack() {}
+
+bool NativeStack::run(size_t, const std::function<void()> &body_)
+{
+    reserved = THREAD_STACK;
+    body_();
+    return true;
+}
+
+#endif
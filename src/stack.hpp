@@ -0,0 +1,71 @@
+#ifndef STACK_HPP
+#define STACK_HPP
+
+#ifdef LOX_NATIVE_STACK
+#include <ucontext.h>
+#endif
+
+#include <cstddef>
+#include <exception>
+#include <functional>
+
+namespace lox
+{
+
+    /// Lox calls either engine lets be active at once, unless --max-depth
+    /// says otherwise. Going deeper is a "Stack overflow." runtime error.
+    const size_t DEFAULT_MAX_DEPTH = 100000;
+
+    /// A native stack of its own for code that recurses as deeply as the
+    /// program it runs, so its depth is bounded by memory rather than by
+    /// the stack of whichever thread called it.
+    ///
+    /// The stack is reserved address space, committed page by page as it
+    /// is touched, and kept for the next run() once reserved. That takes
+    /// ucontext and mmap(), which the build checks for; without them
+    /// (LOX_NATIVE_STACK undefined) run() calls `body` on the caller's own
+    /// stack, assumed to be THREAD_STACK bytes.
+    class NativeStack
+    {
+    public:
+        NativeStack() {}
+
+        ~NativeStack();
+
+        NativeStack(const NativeStack &) = delete;
+        NativeStack &operator=(const NativeStack &) = delete;
+
+        /// Runs `body` on a stack of at least `bytes` and returns when it
+        /// does. Whatever `body` throws is rethrown to the caller. Returns
+        /// false, without running `body`, if the stack cannot be reserved.
+        bool run(size_t bytes, const std::function<void()> &body_);
+
+        /// Bytes of stack the last run() gave `body`.
+        size_t size() const { return reserved; }
+
+        static const size_t THREAD_STACK = 8 << 20;
+
+    private:
+        size_t reserved = 0;
+
+#ifdef LOX_NATIVE_STACK
+        char *memory = nullptr;
+
+        ucontext_t caller;
+        ucontext_t context;
+        const std::function<void()> *body = nullptr;
+        std::exception_ptr error;
+
+        /// The caller's stack, for AddressSanitizer builds.
+        const void *callerBottom = nullptr;
+        size_t callerSize = 0;
+
+        bool reserve(size_t bytes);
+
+        /// makecontext() only passes ints, so `this` comes in two halves.
+        static void enter(unsigned high, unsigned low);
+#endif
+    };
+} // namespace lox
+
+#endif
@@ -0,0 +1,505 @@
+#include <algorithm>
+#include <iostream>
+
+#include "natives.hpp"
+#include "vm.hpp"
+
+using namespace lox;
+
+static ClosureObj *asClosure(const Value &value)
+{
+    return static_cast<ClosureObj *>(value.as.object);
+}
+
+static bool isClosure(const Value &value)
+{
+    return value.isObj() && value.as.object->type == ObjectType::ClosureType;
+}
+
+VM::VM(Heap &heap_) : heap(heap_), stack(INITIAL_STACK)
+{
+    frames.reserve(INITIAL_FRAMES);
+    stackTop = stack.data();
+    heap.addRoots(this);
+    defineNatives(heap, [this](StrObj *name, Value native) { globals[name] = native; });
+}
+
+VM::~VM()
+{
+    heap.removeRoots(this);
+}
+
+void VM::markRoots(Heap &heap_)
+{
+    for (Value *slot = stack.data(); slot < stackTop; slot++)
+        heap_.mark(*slot);
+    for (auto &frame : frames)
+        heap_.mark(frame.closure);
+    for (Upvalue *upvalue : openUpvalues)
+        heap_.mark(upvalue);
+    for (auto &global : globals)
+        heap_.mark(global.second);
+
+    // Constants of every prototype, including one still being compiled.
+    for (auto &function : functions)
+    {
+        for (auto &constant : function->chunk.constants)
+            heap_.mark(constant);
+    }
+}
+
+void VM::interpret(FunctionProto *script)
+{
+    push(Value(heap.make<ClosureObj>(script)));
+    try
+    {
+        callValue(peek(0), 0);
+        run();
+    }
+    catch (RuntimeError &)
+    {
+        reset();
+        throw;
+    }
+}
+
+void VM::resetGlobals()
+{
+    for (auto it = globals.begin(); it != globals.end();)
+    {
+        if (it->second.isNative())
+            ++it;
+        else
+            it = globals.erase(it);
+    }
+
+    // Cached slots may point at erased entries.
+    for (auto &function : functions)
+        std::fill(function->chunk.globalSlots.begin(), function->chunk.globalSlots.end(), nullptr);
+}
+
+void VM::reset()
+{
+    while (stackTop != stack.data())
+        pop();
+    frames.clear();
+    openUpvalues.clear();
+}
+
+RuntimeError VM::error(const std::string &message)
+{
+    CallFrame &frame = frames.back();
+    size_t offset = frame.ip - frame.closure->function->chunk.code.data() - 1;
+    return RuntimeError(frame.closure->function->chunk.lines[offset], message);
+}
+
+void VM::callValue(Value &callee, int argCount)
+{
+    if (callee.isNative())
+    {
+        callNative(callee.asNative(), argCount);
+        return;
+    }
+
+    if (!isClosure(callee))
+        throw error("Can only call functions.");
+
+    ClosureObj *closure = asClosure(callee);
+    if (argCount != closure->function->arity)
+        throw error("Expected " + std::to_string(closure->function->arity) +
+                    " arguments but got " + std::to_string(argCount) + ".");
+
+    // The script's own frame is not a call.
+    if (frames.size() > maxDepth)
+        throw error("Stack overflow.");
+
+    Value *slots = reserveFrame(stackTop - argCount - 1, closure->function);
+    frames.push_back({closure, closure->function->chunk.code.data(), slots});
+}
+
+Value *VM::reserveFrame(Value *slots, const FunctionProto *function)
+{
+    size_t needed = static_cast<size_t>(slots - stack.data()) + function->maxStack;
+    if (needed <= stack.size())
+        return slots;
+
+    std::vector<Value> grown(std::max(stack.size() * 2, needed));
+    std::copy(stack.data(), stackTop, grown.data());
+
+    Value *from = stack.data();
+    Value *to = grown.data();
+    stackTop = to + (stackTop - from);
+    for (auto &frame : frames)
+        frame.slots = to + (frame.slots - from);
+    for (Upvalue *upvalue : openUpvalues)
+        upvalue->location = to + (upvalue->location - from);
+
+    stack.swap(grown);
+    return to + (slots - from);
+}
+
+void VM::tailCall(Value &callee, int argCount)
+{
+    if (callee.isNative())
+    {
+        callNative(callee.asNative(), argCount);
+        return;
+    }
+
+    if (!isClosure(callee))
+        throw error("Can only call functions.");
+
+    ClosureObj *closure = asClosure(callee);
+    if (argCount != closure->function->arity)
+        throw error("Expected " + std::to_string(closure->function->arity) +
+                    " arguments but got " + std::to_string(argCount) + ".");
+
+    // The callee and its arguments slide down over the current frame once
+    // anything captured from it is closed.
+    reserveFrame(frames.back().slots, closure->function);
+    CallFrame &frame = frames.back();
+    closeUpvalues(frame.slots);
+    std::copy(stackTop - argCount - 1, stackTop, frame.slots);
+    stackTop = frame.slots + argCount + 1;
+    frame.closure = closure;
+    frame.ip = closure->function->chunk.code.data();
+}
+
+void VM::callNative(NativeObj *native, int argCount)
+{
+    if (static_cast<size_t>(argCount) != native->arity)
+        throw error("Expected " + std::to_string(native->arity) +
+                    " arguments but got " + std::to_string(argCount) + ".");
+
+    Value result;
+    try
+    {
+        result = native->function(heap, stackTop - argCount);
+    }
+    catch (NativeError &nativeError)
+    {
+        throw error(nativeError.what());
+    }
+
+    stackTop -= argCount + 1;
+    push(result);
+}
+
+Upvalue *VM::captureUpvalue(Value *local)
+{
+    // Open upvalues are kept sorted by stack address.
+    auto it = openUpvalues.end();
+    while (it != openUpvalues.begin() && (*(it - 1))->location >= local)
+    {
+        --it;
+        if ((*it)->location == local)
+            return *it;
+    }
+
+    Upvalue *upvalue = heap.make<Upvalue>(local);
+    openUpvalues.insert(it, upvalue);
+    return upvalue;
+}
+
+void VM::closeUpvalues(Value *last)
+{
+    while (!openUpvalues.empty() && openUpvalues.back()->location >= last)
+    {
+        Upvalue *upvalue = openUpvalues.back();
+        upvalue->closed = std::move(*upvalue->location);
+        upvalue->location = &upvalue->closed;
+        openUpvalues.pop_back();
+    }
+}
+
+Value *VM::global(StrObj *name, Value *&cache, CacheStats &stats)
+{
+    // Prototypes only run on the VM that compiled them and globals are only
+    // removed by resetGlobals(), which clears every entry, so a filled entry
+    // is always valid.
+    if (cache)
+    {
+        if (countCacheHits)
+            stats.hits++;
+        return cache;
+    }
+
+    stats.misses++;
+    auto it = globals.find(name);
+    if (it != globals.end())
+        cache = &it->second;
+    return cache;
+}
+
+void VM::sample()
+{
+    if (!profiler)
+        return;
+
+    std::string stack;
+    for (auto &frame : frames)
+        Profiler::appendFrame(stack, frame.closure->function->name, frame.closure->function->line);
+    profiler->record(stack);
+}
+
+void VM::run()
+{
+    CallFrame *frame = &frames.back();
+    const uint8_t *ip = frame->ip;
+    const Value *constants = frame->closure->function->chunk.constants.data();
+    Value **globalSlots = frame->closure->function->chunk.globalSlots.data();
+
+#define READ_BYTE() (*ip++)
+#define READ_SHORT() (ip += 2, static_cast<uint16_t>((ip[-2] << 8) | ip[-1]))
+#define READ_CONSTANT() (constants[READ_SHORT()])
+#define SAVE_FRAME() (frame->ip = ip)
+#define LOAD_FRAME()                                                     \
+    do                                                                   \
+    {                                                                    \
+        frame = &frames.back();                                          \
+        ip = frame->ip;                                                  \
+        constants = frame->closure->function->chunk.constants.data();   \
+        globalSlots = frame->closure->function->chunk.globalSlots.data(); \
+    } while (false)
+#define CHECK_NUMBERS()                                      \
+    do                                                       \
+    {                                                        \
+        if (!peek(0).isNum() || !peek(1).isNum())            \
+        {                                                    \
+            SAVE_FRAME();                                    \
+            throw error("Operands must be numbers.");        \
+        }                                                    \
+    } while (false)
+#define BINARY_OP(op)                                        \
+    do                                                       \
+    {                                                        \
+        CHECK_NUMBERS();                                     \
+        double b = pop().asNum();                            \
+        double a = pop().asNum();                            \
+        push(Value(a op b));                                 \
+    } while (false)
+
+    while (true)
+    {
+        switch (static_cast<OpCode>(READ_BYTE()))
+        {
+        case OpCode::CONSTANT:
+            push(READ_CONSTANT());
+            break;
+        case OpCode::NIL:
+            push(Value());
+            break;
+        case OpCode::TRUE:
+            push(Value(true));
+            break;
+        case OpCode::FALSE:
+            push(Value(false));
+            break;
+        case OpCode::POP:
+            pop();
+            break;
+        case OpCode::GET_LOCAL:
+            push(frame->slots[READ_BYTE()]);
+            break;
+        case OpCode::SET_LOCAL:
+            frame->slots[READ_BYTE()] = peek(0);
+            break;
+        case OpCode::GET_GLOBAL:
+        {
+            uint16_t index = READ_SHORT();
+            Value *slot = global(constants[index].asStr(), globalSlots[index], globalReads);
+            if (!slot)
+            {
+                SAVE_FRAME();
+                throw error("Undefined variable '" + constants[index].asStr()->value + "'.");
+            }
+            push(*slot);
+            break;
+        }
+        case OpCode::DEFINE_GLOBAL:
+        {
+            StrObj *name = READ_CONSTANT().asStr();
+            globals[name] = pop();
+            break;
+        }
+        case OpCode::SET_GLOBAL:
+        {
+            uint16_t index = READ_SHORT();
+            Value *slot = global(constants[index].asStr(), globalSlots[index], globalWrites);
+            if (!slot)
+            {
+                SAVE_FRAME();
+                throw error("Undefined variable '" + constants[index].asStr()->value + "'.");
+            }
+            *slot = peek(0);
+            break;
+        }
+        case OpCode::GET_UPVALUE:
+            push(*frame->closure->upvalues[READ_BYTE()]->location);
+            break;
+        case OpCode::SET_UPVALUE:
+            *frame->closure->upvalues[READ_BYTE()]->location = peek(0);
+            break;
+        case OpCode::EQUAL:
+        {
+            Value b = pop();
+            Value a = pop();
+            push(Value(a.equals(b)));
+            break;
+        }
+        case OpCode::NOT_EQUAL:
+        {
+            Value b = pop();
+            Value a = pop();
+            push(Value(!a.equals(b)));
+            break;
+        }
+        case OpCode::GREATER:
+            BINARY_OP(>);
+            break;
+        case OpCode::GREATER_EQUAL:
+            BINARY_OP(>=);
+            break;
+        case OpCode::LESS:
+            BINARY_OP(<);
+            break;
+        case OpCode::LESS_EQUAL:
+            BINARY_OP(<=);
+            break;
+        case OpCode::ADD:
+        {
+            if (peek(0).isNum() && peek(1).isNum())
+            {
+                double b = pop().asNum();
+                double a = pop().asNum();
+                push(Value(a + b));
+            }
+            else if (peek(0).isStr() && peek(1).isStr())
+            {
+                // Both stay on the stack until the result exists, since a
+                // rope refers to them.
+                StrObj *result = heap.concat(peek(1).asStr(), peek(0).asStr());
+                pop();
+                pop();
+                push(Value(result));
+            }
+            else
+            {
+                SAVE_FRAME();
+                throw error("Operands must be two numbers or two strings.");
+            }
+            break;
+        }
+        case OpCode::SUBTRACT:
+            BINARY_OP(-);
+            break;
+        case OpCode::MULTIPLY:
+            BINARY_OP(*);
+            break;
+        case OpCode::DIVIDE:
+            BINARY_OP(/);
+            break;
+        case OpCode::NOT:
+            push(Value(!pop().isTrue()));
+            break;
+        case OpCode::NEGATE:
+            if (!peek(0).isNum())
+            {
+                SAVE_FRAME();
+                throw error("Operand must be a number.");
+            }
+            push(Value(-pop().asNum()));
+            break;
+        case OpCode::PRINT:
+            std::cout << pop().toString() << std::endl;
+            break;
+        case OpCode::JUMP:
+        {
+            uint16_t offset = READ_SHORT();
+            ip += offset;
+            break;
+        }
+        case OpCode::JUMP_IF_FALSE:
+        {
+            uint16_t offset = READ_SHORT();
+            if (!peek(0).isTrue())
+                ip += offset;
+            break;
+        }
+        case OpCode::LOOP:
+        {
+            uint16_t offset = READ_SHORT();
+            ip -= offset;
+            if (Profiler::pending)
+                sample();
+            break;
+        }
+        case OpCode::CALL:
+        {
+            int argCount = READ_BYTE();
+            SAVE_FRAME();
+            callValue(peek(argCount), argCount);
+            LOAD_FRAME();
+            if (Profiler::pending)
+                sample();
+            break;
+        }
+        case OpCode::TAIL_CALL:
+        {
+            int argCount = READ_BYTE();
+            SAVE_FRAME();
+            tailCall(peek(argCount), argCount);
+            LOAD_FRAME();
+            if (Profiler::pending)
+                sample();
+            break;
+        }
+        case OpCode::CLOSURE:
+        {
+            FunctionProto *function = functions[READ_SHORT()].get();
+            ClosureObj *closure = heap.make<ClosureObj>(function);
+            // Pushed before capturing so the collector can see it.
+            push(Value(closure));
+            for (int i = 0; i < function->upvalueCount; i++)
+            {
+                uint8_t isLocal = READ_BYTE();
+                uint8_t index = READ_BYTE();
+                if (isLocal)
+                    closure->upvalues[i] = captureUpvalue(frame->slots + index);
+                else
+                    closure->upvalues[i] = frame->closure->upvalues[index];
+            }
+            break;
+        }
+        case OpCode::CLOSE_UPVALUE:
+            closeUpvalues(stackTop - 1);
+            pop();
+            break;
+        case OpCode::RETURN:
+        {
+            Value result = pop();
+            closeUpvalues(frame->slots);
+            Value *slots = frame->slots;
+            frames.pop_back();
+
+            while (stackTop != slots)
+                pop();
+
+            if (frames.empty())
+                return;
+
+            push(std::move(result));
+            LOAD_FRAME();
+            break;
+        }
+        }
+    }
+
+#undef READ_BYTE
+#undef READ_SHORT
+#undef READ_CONSTANT
+#undef SAVE_FRAME
+#undef LOAD_FRAME
+#undef CHECK_NUMBERS
+#undef BINARY_OP
+}
@@ -0,0 +1,106 @@
+#ifndef VM_HPP
+#define VM_HPP
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "chunk.hpp"
+#include "compiler.hpp"
+#include "heap.hpp"
+#include "profiler.hpp"
+#include "stack.hpp"
+
+namespace lox
+{
+
+    /// Stack-based bytecode interpreter, the alternative to the tree-walking
+    /// Interpreter selected with --engine=vm.
+    class VM : GCRoots
+    {
+    public:
+        /// Slots and frames the stack starts out with room for. It grows
+        /// as calls need more.
+        static const size_t INITIAL_STACK = 16384;
+        static const size_t INITIAL_FRAMES = 64;
+
+        /// Function calls that may be active at once before a call fails
+        /// with a stack overflow; set by --max-depth.
+        size_t maxDepth = DEFAULT_MAX_DEPTH;
+
+        /// Every prototype compiled so far. Closures stored in globals may
+        /// outlive the script that defined them, so the table only grows.
+        ProtoList functions;
+
+        Heap &heap;
+
+        /// Set while running under --profile.
+        Profiler *profiler = nullptr;
+
+        /// Inline caches on GET_GLOBAL and SET_GLOBAL. Misses are always
+        /// counted, hits only when asked for since they are the hot path.
+        CacheStats globalReads;
+        CacheStats globalWrites;
+        bool countCacheHits = false;
+
+        VM(Heap &heap_);
+
+        ~VM();
+
+        VM(const VM &) = delete;
+        VM &operator=(const VM &) = delete;
+
+        void interpret(FunctionProto *script);
+
+        /// Starts over with only the natives defined, for running a program
+        /// again from scratch.
+        void resetGlobals();
+
+        void defineGlobal(StrObj *name, Value value) { globals[name] = value; }
+
+        void markRoots(Heap &heap_) override;
+
+    private:
+        struct CallFrame
+        {
+            ClosureObj *closure;
+            const uint8_t *ip;
+            Value *slots;
+        };
+
+        std::vector<Value> stack;
+        Value *stackTop;
+        std::vector<CallFrame> frames;
+        std::vector<Upvalue *> openUpvalues;
+        std::unordered_map<StrObj *, Value> globals;
+
+        void run();
+        void reset();
+
+        void push(Value value) { *stackTop++ = std::move(value); }
+        Value pop() { return std::move(*--stackTop); }
+        Value &peek(int distance) { return stackTop[-1 - distance]; }
+
+        void callValue(Value &callee, int argCount);
+
+        /// Makes room for a frame of `function` starting at `slots`, moving
+        /// the stack, and the frames and open upvalues pointing into it, if
+        /// it has to grow. Returns where `slots` ends up.
+        Value *reserveFrame(Value *slots, const FunctionProto *function);
+
+        /// Calls `callee` in place of the current frame. Natives are called
+        /// as usual, leaving their result for the RETURN that follows.
+        void tailCall(Value &callee, int argCount);
+        void callNative(NativeObj *native, int argCount);
+        Upvalue *captureUpvalue(Value *local);
+        void closeUpvalues(Value *last);
+
+        Value *global(StrObj *name, Value *&cache, CacheStats &stats);
+
+        void sample();
+
+        RuntimeError error(const std::string &message);
+    };
+} // namespace lox
+
+#endif
@@ -0,0 +1,161 @@
+# Runs a script several times under --cache and checks when the cache file
+# is written, reused and replaced:
+#
+#   - a first run writes <script>.cache, and a second run reuses it as is;
+#   - editing the script makes the cache stale, so it is parsed and rewritten;
+#   - a truncated, garbled or subtly corrupt cache file is ignored, parsed
+#     and rewritten;
+#   - --cache=<dir> keeps the cache file in <dir> instead.
+#
+# A reused cache file is never written, so each check sets the file's time
+# back to 1970 before a run and looks at whether the run replaced it.
+#
+# Invoked by ctest as
+#   cmake -DLOX=<interpreter> -DENGINE=<tree|vm> -DWORK=<scratch dir> -P cache_test.cmake
+
+file(REMOVE_RECURSE ${WORK})
+file(MAKE_DIRECTORY ${WORK})
+set(script ${WORK}/script.lox)
+set(cache ${script}.cache)
+
+function(run_lox expected)
+    execute_process(COMMAND ${LOX} --engine=${ENGINE} ${ARGN} ${script}
+                    OUTPUT_VARIABLE output
+                    ERROR_VARIABLE errors
+                    RESULT_VARIABLE result)
+    if(NOT result EQUAL 0 OR NOT errors STREQUAL "")
+        message(FATAL_ERROR "${LOX} exited with ${result}\n${errors}")
+    endif()
+    if(NOT output STREQUAL expected)
+        message(FATAL_ERROR "Expected output:\n${expected}\nGot:\n${output}")
+    endif()
+endfunction()
+
+function(age file)
+    execute_process(COMMAND touch -t 197001020000 ${file} RESULT_VARIABLE result)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "Could not set the time of ${file}")
+    endif()
+endfunction()
+
+# Fails unless `file` exists and was (`rewritten` true) or was not written
+# since age() was last called on it.
+function(check_written file rewritten what)
+    if(NOT EXISTS ${file})
+        message(FATAL_ERROR "${what}: ${file} was not written")
+    endif()
+    file(TIMESTAMP ${file} time "%Y" UTC)
+    if(rewritten AND time STREQUAL "1970")
+        message(FATAL_ERROR "${what}: ${file} was not rewritten")
+    elseif(NOT rewritten AND NOT time STREQUAL "1970")
+        message(FATAL_ERROR "${what}: ${file} was rewritten instead of reused")
+    endif()
+endfunction()
+
+set(greet "fun greet(name) { return \"hello \" + name; }\nprint greet(\"cache\");\nprint 6 * 7;\n")
+file(WRITE ${script} "${greet}")
+set(first "hello cache\n42.000000\n")
+
+run_lox("${first}" --cache)
+if(NOT EXISTS ${cache})
+    message(FATAL_ERROR "round trip: ${cache} was not written")
+endif()
+file(READ ${cache} saved HEX)
+
+age(${cache})
+run_lox("${first}" --cache)
+check_written(${cache} FALSE "round trip")
+
+age(${cache})
+file(WRITE ${script} "print \"edited\";\n")
+run_lox("edited\n" --cache)
+check_written(${cache} TRUE "stale cache")
+
+# Back to the first source, whose cache is then the same file as before.
+file(WRITE ${script} "${greet}")
+run_lox("${first}" --cache)
+file(READ ${cache} resaved HEX)
+if(NOT resaved STREQUAL saved)
+    message(FATAL_ERROR "stale cache: the same script gave a different cache file")
+endif()
+
+# Cut the file off halfway through.
+file(SIZE ${cache} size)
+math(EXPR half "${size} / 2")
+execute_process(COMMAND truncate -s ${half} ${cache})
+age(${cache})
+run_lox("${first}" --cache)
+check_written(${cache} TRUE "truncated cache")
+
+# Keep the 32-byte header, which still matches the source and the
+# interpreter, and replace the tokens and tree with junk.
+execute_process(COMMAND truncate -s 32 ${cache})
+file(APPEND ${cache} "this is not a syntax tree, nor a token table")
+age(${cache})
+run_lox("${first}" --cache)
+check_written(${cache} TRUE "garbled cache")
+file(READ ${cache} repaired HEX)
+if(NOT repaired STREQUAL saved)
+    message(FATAL_ERROR "garbled cache: the rewritten file differs from the original")
+endif()
+
+# Corrupt the tree itself, keeping the header and the length consistent,
+# in a cache of this script, whose layout is:
+#
+#   header (32 bytes), 3 tokens (16 bytes each): `a`, `a`, `+`
+#   80  statement count
+#   84  VarStmt: tag, line, name token, NumLiteralExpr (13 bytes)
+#   106 PrintStmt: tag, line,
+#   111   BinaryExpr: tag, line,
+#   116     VarExpr: tag, line, name token (121),
+#   125     operator token, NumLiteralExpr
+file(WRITE ${script} "var a = 1;\nprint a + 1;\n")
+set(second "2.000000\n")
+run_lox("${second}" --cache)
+file(READ ${cache} tree HEX)
+string(SUBSTRING "${tree}" 8 8 tokenCount)
+string(SUBSTRING "${tree}" 242 2 nameToken)
+if(NOT tokenCount STREQUAL "03000000" OR NOT nameToken STREQUAL "01")
+    message(FATAL_ERROR "corrupt tree: the cache layout changed; update this test")
+endif()
+
+# Writes the byte with octal code `octal` at `offset` in `file`.
+function(patch file offset octal)
+    execute_process(COMMAND printf "\\${octal}" OUTPUT_FILE ${WORK}/byte)
+    execute_process(COMMAND dd if=${WORK}/byte of=${file} bs=1 seek=${offset} conv=notrunc
+                    RESULT_VARIABLE result ERROR_QUIET)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "Could not patch ${file}")
+    endif()
+endfunction()
+
+# A missing operand where one is required, with the file ending after it.
+patch(${cache} 111 377)
+execute_process(COMMAND truncate -s 112 ${cache})
+age(${cache})
+run_lox("${second}" --cache)
+check_written(${cache} TRUE "missing required node")
+
+# A variable named by the `+` token instead of an identifier.
+patch(${cache} 121 002)
+age(${cache})
+run_lox("${second}" --cache)
+check_written(${cache} TRUE "name that is not an identifier")
+
+# --cache=<dir> leaves nothing next to the script.
+file(REMOVE ${cache})
+file(WRITE ${script} "${greet}")
+set(dir ${WORK}/caches)
+file(MAKE_DIRECTORY ${dir})
+run_lox("${first}" --cache=${dir})
+if(EXISTS ${cache})
+    message(FATAL_ERROR "--cache=<dir>: wrote ${cache} next to the script")
+endif()
+file(GLOB cached ${dir}/*)
+list(LENGTH cached count)
+if(NOT count EQUAL 1)
+    message(FATAL_ERROR "--cache=<dir>: expected one file in ${dir}, found ${count}")
+endif()
+age(${cached})
+run_lox("${first}" --cache=${dir})
+check_written(${cached} FALSE "--cache=<dir>")
@@ -0,0 +1,89 @@
+// Compiles one script and executes it over several sets of Bindings on each
+// engine, checking what it prints. Exits non-zero on the first mismatch.
+
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "runtime.hpp"
+
+namespace
+{
+    const char *SCRIPT = "var total = amount * 2;\n"
+                         "print name + \": \" + \"ok\";\n"
+                         "print total;\n"
+                         "print flag;\n"
+                         "print missing;\n";
+
+    bool failed = false;
+
+    void expect(bool condition, const std::string &what)
+    {
+        if (!condition)
+        {
+            std::cerr << "FAILED: " << what << std::endl;
+            failed = true;
+        }
+    }
+
+    /// Runs `program` with `bindings`, returning what it printed.
+    std::string capture(const lox::Program &program, lox::Runtime &runtime, const lox::Bindings &bindings, bool &ok)
+    {
+        std::ostringstream output;
+        std::streambuf *saved = std::cout.rdbuf(output.rdbuf());
+        ok = lox::execute(program, runtime, bindings);
+        std::cout.rdbuf(saved);
+        return output.str();
+    }
+
+    void testEngine(lox::Engine engine, const char *label)
+    {
+        lox::Options options;
+        options.engine = engine;
+        lox::Runtime runtime(options);
+        std::string name(label);
+
+        lox::Program program = lox::compile(lox::SourceBuffer(SCRIPT), runtime);
+        expect(static_cast<bool>(program), name + ": compile");
+
+        lox::Bindings first;
+        first.set("name", "first");
+        first.set("amount", 21);
+        first.set("flag", true);
+        first.setNil("missing");
+        bool ok;
+        std::string output = capture(program, runtime, first, ok);
+        expect(ok, name + ": first execute");
+        expect(output == "first: ok\n42.000000\n1\nNil\n", name + ": first output was\n" + output);
+
+        // Globals from the first run, `total` included, must not leak into
+        // the second.
+        lox::Bindings second;
+        second.set("name", std::string("second"));
+        second.set("amount", 0.5);
+        second.set("flag", false);
+        second.setNil("missing");
+        output = capture(program, runtime, second, ok);
+        expect(ok, name + ": second execute");
+        expect(output == "second: ok\n1.000000\n0\nNil\n", name + ": second output was\n" + output);
+
+        // Without `missing` the script stops on an undefined variable.
+        lox::Bindings partial;
+        partial.set("name", "third");
+        partial.set("amount", 1);
+        partial.set("flag", true);
+        output = capture(program, runtime, partial, ok);
+        expect(!ok, name + ": execute with a missing binding should fail");
+
+        lox::Program broken = lox::compile(lox::SourceBuffer("print 1 +;"), runtime);
+        expect(!broken, name + ": a compile error should give an empty Program");
+        expect(!lox::execute(broken, runtime), name + ": executing an empty Program should fail");
+    }
+} // namespace
+
+int main()
+{
+    testEngine(lox::Engine::Tree, "tree");
+    testEngine(lox::Engine::VM, "vm");
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,48 @@
+# Runs one Lox script and checks its output against the comments in it:
+#
+#   print 1 + 2; // expect: 3.000000
+#   f(); // expect runtime error: Stack overflow.
+#   print 1 +; // expect error: Expect expression.
+#
+# Invoked by ctest as
+#   cmake -DLOX=<interpreter> -DSCRIPT=<file.lox> [-DARGS=<a|b|...>] -P run_test.cmake
+
+string(REPLACE "|" ";" args "${ARGS}")
+execute_process(COMMAND ${LOX} ${args} ${SCRIPT}
+                OUTPUT_VARIABLE output
+                ERROR_VARIABLE errors
+                RESULT_VARIABLE result)
+
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "${LOX} exited with ${result}\n${errors}")
+endif()
+
+set(expected "")
+set(expectedErrors "")
+file(STRINGS ${SCRIPT} lines REGEX "// expect")
+foreach(line ${lines})
+    if(line MATCHES "// expect: (.*)$")
+        set(expected "${expected}${CMAKE_MATCH_1}\n")
+    elseif(line MATCHES "// expect runtime error: (.*)$")
+        list(APPEND expectedErrors "Runtime error: ${CMAKE_MATCH_1}")
+    elseif(line MATCHES "// expect error: (.*)$")
+        list(APPEND expectedErrors ": ${CMAKE_MATCH_1}")
+    endif()
+endforeach()
+
+if(NOT output STREQUAL expected)
+    message(FATAL_ERROR "Expected output:\n${expected}\nGot:\n${output}\n${errors}")
+endif()
+
+if(expectedErrors STREQUAL "")
+    if(NOT errors STREQUAL "")
+        message(FATAL_ERROR "Unexpected errors:\n${errors}")
+    endif()
+else()
+    foreach(expectedError ${expectedErrors})
+        string(FIND "${errors}" "${expectedError}" found)
+        if(found EQUAL -1)
+            message(FATAL_ERROR "Expected error: ${expectedError}\nGot:\n${errors}")
+        endif()
+    endforeach()
+endif()